@@ -22,8 +22,17 @@
 #pragma once
 
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include "Memory.h"
+#include "Tracer.h"
+#if SER_PROFILE_USER_TYPES
+#   include "Profiler.h"
+#endif
 
 
 namespace ser
@@ -80,8 +89,72 @@ static unsigned type_id()
     return SDBMHash(type_name<T>());
 }
 
+/// Serialized form of a value kept by SerializationCache. Each archive format stores a subclass of its own.
+class CachedValue
+{
+public:
+    virtual ~CachedValue() = default;
+};
+
 }   // namespace detail
 
+/// Serialized form of a single user object, reused by Archive::SerializeCached() for as long as object does not
+/// change. Embed it into the object and call Invalidate() whenever object is modified. Cache is not thread-safe, an
+/// object may not be serialized by multiple threads at once.
+class SerializationCache
+{
+public:
+    /// Discard serialized form, so that object is serialized anew next time. Increments generation of object.
+    void Invalidate()
+    {
+        generation_++;
+        entries_.clear();
+    }
+    /// Returns number of times object was invalidated.
+    uint64_t GetGeneration() const { return generation_; }
+
+    /// Returns serialized form stored by archive of specified format for current generation, or null.
+    std::shared_ptr<const detail::CachedValue> Get(unsigned format) const
+    {
+        for (const auto& entry : entries_)
+        {
+            if (entry.format_ == format && entry.generation_ == generation_)
+                return entry.value_;
+        }
+        return nullptr;
+    }
+    /// Store serialized form of object produced by archive of specified format for current generation.
+    void Set(unsigned format, std::shared_ptr<const detail::CachedValue> value)
+    {
+        for (auto& entry : entries_)
+        {
+            if (entry.format_ == format)
+            {
+                entry.generation_ = generation_;
+                entry.value_ = std::move(value);
+                return;
+            }
+        }
+        entries_.push_back({format, generation_, std::move(value)});
+    }
+
+private:
+    struct Entry
+    {
+        /// Type id of archive which stored the value.
+        unsigned format_;
+        /// Generation of object when value was stored.
+        uint64_t generation_;
+        /// Serialized form of object. Archives that splice it into their documents share ownership.
+        std::shared_ptr<const detail::CachedValue> value_;
+    };
+
+    /// Number of times object was invalidated.
+    uint64_t generation_ = 0;
+    /// Serialized forms of object, one per archive format.
+    std::vector<Entry> entries_;
+};
+
 // Forwarding iterator. Runtime polymorphism without dynamic memory allocation. This will serve as universal iterator
 // for both both arrays and objects.
 class ArchiveIterator
@@ -95,14 +168,34 @@ public:
     {
         // Copy() will invoke Construct(*this, *other.Get()) which will copy-construct internal iterator from other
         // object into this one.
-        other.Get()->Copy(*this);
+        if (!other.is_null_)
+            other.Get()->Copy(*this);
+    }
+
+    /// Move-construct from another iterator. Traced container span ends when this iterator is destroyed instead.
+    ArchiveIterator(ArchiveIterator&& other) noexcept
+        : ArchiveIterator(static_cast<const ArchiveIterator&>(other))
+    {
+        traced_ = other.traced_;
+        other.traced_ = false;
+    }
+
+    /// Copy-assign from another iterator.
+    ArchiveIterator& operator=(const ArchiveIterator& other)
+    {
+        if (this != &other)
+        {
+            Release();
+            if (!other.is_null_)
+                other.Get()->Copy(*this);
+        }
+        return *this;
     }
 
     /// Destruct underlying iterator.
     ~ArchiveIterator()
     {
-        if (!is_null_)
-            Get()->~IArchiveIterator();
+        Release();
     }
 
     template<typename T, typename... Args>
@@ -133,31 +226,46 @@ public:
     /// Returns true if iterator is not null and not at an end.
     operator bool() const                                      { return !AtEnd(); }                         // NOLINT(google-explicit-constructor)
     /// Returns new archive iterator at specified index. Returns null iterator if this instance is not iterating an array.
-    ArchiveIterator operator[](int index)                      { return Get()->operator[](index); }
+    ArchiveIterator operator[](int index)                      { return is_null_ ? ArchiveIterator{} : Get()->operator[](index); }
     /// Returns new archive iterator at specified key. Returns null iterator if this instance is not iterating a map.
-    ArchiveIterator operator[](const std::string& key)         { return Get()->Find(key); }
+    ArchiveIterator operator[](const std::string& key)         { return is_null_ ? ArchiveIterator{} : Get()->Find(key); }
     /// Returns new archive iterator at specified key. Returns null iterator if this instance is not iterating a map.
-    ArchiveIterator operator[](const char* key)                { return Get()->Find(key); }
+    ArchiveIterator operator[](const char* key)                { return is_null_ ? ArchiveIterator{} : Get()->Find(key); }
     /// Increments this iterator in-place and returns reference to itself.
-    ArchiveIterator& operator++()                              { Get()->operator++(); return *this; }
+    ArchiveIterator& operator++()                              { if (!is_null_) Get()->operator++(); return *this; }
     /// Returns a copy of current iterator and increments this instance afterwards.
-    ArchiveIterator operator++(int i)                                                                                   // NOLINT(cert-dcl21-cpp)
+    ArchiveIterator operator++(int)                                                                                     // NOLINT(cert-dcl21-cpp)
     {
-        ArchiveIterator result;
-        Get()->Copy(result);
+        ArchiveIterator result(*this);
         operator++();
         return result;
     }
 
 protected:
-    /// Flag indicating that
-    bool is_null_ = false;
+    /// Destruct underlying iterator and end traced span.
+    void Release()
+    {
+        if (traced_)
+            detail::TraceEnd("container");
+        traced_ = false;
+
+        if (!is_null_)
+            Get()->~IArchiveIterator();
+        is_null_ = true;
+    }
+
+    /// Flag indicating that iterator does not hold internal archive iterator.
+    bool is_null_ = true;
+    /// Flag indicating that iterator was returned by Archive::Begin() and ends a traced span when destroyed.
+    bool traced_ = false;
     /// Static storage for dynamic iterator object.
-    uint8_t storage_[64]{};
+    alignas(std::max_align_t) uint8_t storage_[64]{};
 
 public:
     /// Max size of internal iterator. Use static_assert() to verify object size against this.
     static const unsigned StorageSize = sizeof(storage_);
+
+    friend class Archive;
 };
 
 class Archive
@@ -172,6 +280,11 @@ public:
 
     using UserTypeSerializers = std::unordered_map<unsigned, bool(*)(Archive*, ArchiveIterator&, void*)>;
 
+    virtual ~Archive() = default;
+
+    /// Clear archive contents so that it can be reused. Memory held by archive is kept for reuse. If highWaterMark is not
+    /// 0 then retained memory is trimmed down to that amount of bytes.
+    virtual void Reset(size_t highWaterMark = 0) = 0;
     /// Begin iteration of a root container.
     virtual ArchiveIterator Begin(ContainerType type) = 0;
     /// Begin iteration of a subcontainer at specified iterator.
@@ -197,8 +310,140 @@ public:
     {
         return Serialize((ArchiveIterator&&)it, detail::type_id<T>(), (void*)&value);
     }
+
+    /// Serialize user-defined type, reusing its serialized form stored in specified cache by a previous call if object
+    /// was not invalidated since. Output archives splice stored form into the document instead of calling serializer,
+    /// therefore serializing mostly unchanged objects takes time proportional to amount of change. Input archives
+    /// always call serializer and invalidate the cache, because they modify the object.
+    template<typename T>
+    bool SerializeCached(ArchiveIterator&& it, T& value, SerializationCache& cache)
+    {
+        return SerializeCached((ArchiveIterator&&)it, detail::type_id<T>(), (void*)&value, cache);
+    }
+
+    /// Serialize user-defined type with specified type id through specified cache. See SerializeCached() above.
+    virtual bool SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& cache)
+    {
+        cache.Invalidate();
+        return Serialize((ArchiveIterator&&)it, typeId, value);
+    }
+
+    /// Serializes element at specified index of an array to specified iterator of specified archive. Archive is not
+    /// necessarily the one SerializeParallel() was called on.
+    using ElementSerializer = bool(*)(Archive* archive, ArchiveIterator&& it, size_t index, void* context);
+
+    /// Serialize array of specified size at specified iterator by calling serializer(archive, element, index, context)
+    /// for each element. Output archives split large arrays into chunks, serialize them on specified number of threads
+    /// (all hardware threads if 0) and splice them into the array in order, therefore result is the same as if array
+    /// was serialized sequentially. Serializer must be safe to call concurrently. Arrays that already have elements and
+    /// input archives are serialized sequentially. Returns false if any element failed to serialize.
+    virtual bool SerializeParallel(ArchiveIterator&& it, size_t count, ElementSerializer serializer, void* context,
+        unsigned /*threads*/ = 0)
+    {
+        if (!it)
+            return false;
+
+        auto array = Begin((ArchiveIterator&&)it, Array);
+        return SerializeRange(array, 0, count, serializer, context);
+    }
+
+    /// Serialize array of specified size at specified iterator by calling function(archive, element, index) for each
+    /// element. See SerializeParallel() above.
+    template<typename Function>
+    bool SerializeParallel(ArchiveIterator&& it, size_t count, Function function, unsigned threads = 0)
+    {
+        return SerializeParallel((ArchiveIterator&&)it, count, [](Archive* archive, ArchiveIterator&& element, size_t index, void* context) {
+            return (*static_cast<Function*>(context))(*archive, (ArchiveIterator&&)element, index);
+        }, (void*)&function, threads);
+    }
+
+    /// Returns memory usage of this archive. Counters accumulate over lifetime of archive, including memory of
+    /// documents, parser and lookup structures.
+    const MemoryStats& GetMemoryStats() const { return memoryStats_; }
+    /// Reset allocation counters and set peak to current usage, so that usage of next operation can be measured.
+    void ResetMemoryStats()
+    {
+        memoryStats_.allocations_ = 0;
+        memoryStats_.allocatedBytes_ = 0;
+        memoryStats_.peakBytes_ = memoryStats_.currentBytes_;
+    }
+
+#if SER_PROFILE_USER_TYPES
+    /// Returns size of value at specified iterator in compact form. Used for profiling user types.
+    virtual size_t MeasureValue(ArchiveIterator& /*it*/) { return 0; }
+#endif
+
+protected:
+    /// Serialize elements with indices in range [begin, end) to consecutive positions of specified array, starting
+    /// with its first element.
+    bool SerializeRange(ArchiveIterator& array, size_t begin, size_t end, ElementSerializer serializer, void* context)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (!serializer(this, array[(int)(i - begin)], i, context))
+                return false;
+        }
+        return true;
+    }
+
+    /// Begin a traced span of container at specified iterator returned by Begin(). Span ends when iterator is
+    /// destroyed. Does nothing if tracer is disabled.
+    static void TraceContainer(ArchiveIterator& it, const char* name, size_t length)
+    {
+        if (!Tracer::IsEnabled() || it.is_null_)
+            return;
+
+        detail::TraceBegin("container", name, length);
+        it.traced_ = true;
+    }
+
+    /// Makes memory stats of an archive current while user type serializers run. Archives which allocate from current
+    /// resource of calling thread declare a scope of the same name which makes their resource current too.
+    class MemoryScope
+    {
+    public:
+        explicit MemoryScope(Archive* archive)
+            : statsScope_(&archive->memoryStats_)
+        {
+        }
+
+    private:
+        /// Makes memory stats of archive current.
+        detail::MemoryStatsScope statsScope_;
+    };
+
+    /// Memory usage of this archive. Memory blocks point to it, therefore it is destroyed after members of subclasses.
+    MemoryStats memoryStats_;
 };
 
+#if SER_PROFILE_USER_TYPES
+// Counts calls, time and size of values of each user type.
+#define SER_USER_CONTAINER_DISPATCH(typeId, it, value)                                                \
+    detail::Stopwatch timer;                                                                          \
+    bool result = GetSerializers()[typeId](this, it, value);                                          \
+    if (auto* counters = GetUserTypeCounters()[typeId])                                               \
+    {                                                                                                 \
+        uint64_t nanoseconds = timer.Elapsed();                                                       \
+        counters->Add(nanoseconds, MeasureValue(it));                                                 \
+    }                                                                                                 \
+    return result
+
+#define SER_USER_CONTAINER_REGISTER(Type, typeId, name)                                               \
+    GetUserTypeCounters()[typeId] = detail::RegisterUserTypeCounters(#Type, name)
+
+#define SER_USER_CONTAINER_COUNTERS()                                                                 \
+    static std::unordered_map<unsigned, detail::UserTypeCounters*>& GetUserTypeCounters()             \
+    {                                                                                                 \
+        static std::unordered_map<unsigned, detail::UserTypeCounters*> counters_;                     \
+        return counters_;                                                                             \
+    }
+#else
+#define SER_USER_CONTAINER_DISPATCH(typeId, it, value)                                                \
+    return GetSerializers()[typeId](this, it, value)
+#define SER_USER_CONTAINER_REGISTER(Type, typeId, name)
+#define SER_USER_CONTAINER_COUNTERS()
+#endif
+
 // Macro that implements user type serialization in format-specific archives. Simply add this macro to class body.
 #define SER_USER_CONTAINER(Type)                                                                      \
 public:                                                                                               \
@@ -206,16 +451,22 @@ public:
     {                                                                                                 \
         if (!it)                                                                                      \
             return false;                                                                             \
-        return GetSerializers()[typeId](this, it, value);                                             \
+        MemoryScope memoryScope(this);                                                                \
+        detail::TraceScope traceScope("user_type",                                                    \
+            Tracer::IsEnabled() ? GetUserTypeNames()[typeId] : nullptr);                              \
+        SER_USER_CONTAINER_DISPATCH(typeId, it, value);                                               \
     }                                                                                                 \
                                                                                                       \
     template<typename T>                                                                              \
-    static void RegisterSerializer(bool(*serializer)(Archive*, ArchiveIterator&, void*))              \
+    static void RegisterSerializer(bool(*serializer)(Archive*, ArchiveIterator&, void*),              \
+        const char* name = nullptr)                                                                   \
     {                                                                                                 \
         auto& serializers = GetSerializers();                                                         \
         if (serializers.find(detail::type_id<T>()) != serializers.end())                              \
             std::terminate();                                                                         \
         serializers[detail::type_id<T>()] = serializer;                                               \
+        GetUserTypeNames()[detail::type_id<T>()] = name != nullptr ? name : "user type";              \
+        SER_USER_CONTAINER_REGISTER(Type, detail::type_id<T>(), name);                                \
     }                                                                                                 \
                                                                                                       \
 private:                                                                                              \
@@ -224,12 +475,18 @@ private:
         static UserTypeSerializers serializers_;                                                      \
         return serializers_;                                                                          \
     }                                                                                                 \
+    static std::unordered_map<unsigned, const char*>& GetUserTypeNames()                              \
+    {                                                                                                 \
+        static std::unordered_map<unsigned, const char*> names_;                                      \
+        return names_;                                                                                \
+    }                                                                                                 \
+    SER_USER_CONTAINER_COUNTERS()                                                                     \
 public:                                                                                               \
 
 // Macro that registers a serialization function for custom user type.
 #define SER_USER_TYPE_SERIALIZER(SubArchive, Type, Function)                                          \
     SubArchive::RegisterSerializer<Type>([](Archive* archive, ArchiveIterator& it, void* value) {     \
         return Function(*static_cast<SubArchive*>(archive), *static_cast<SubArchive::Iterator*>(it.Get()), *(Type*)value);\
-    })                                                                                                \
+    }, #Type)                                                                                         \
 
 }   // namespace ser
@@ -0,0 +1,236 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+
+namespace ser
+{
+
+/// Pool of reusable archives of type T, meant for serving many short serializations on multiple threads. Archives are
+/// handed out from a per-thread free list, which needs no locking. When it is empty or full, a shared pool protected by
+/// a mutex is used. Archives are Reset() when returned, therefore they keep memory of previous documents and do not
+/// allocate when documents of similar size are serialized again. Archives outlive any MemoryResourceScope of a request,
+/// therefore they are constructed from a null resource and allocate from heap.
+template<typename T>
+class ArchivePool
+{
+public:
+    /// Owning handle of pooled archive. Returns archive to the pool when it goes out of scope.
+    class Handle
+    {
+    public:
+        Handle() = default;
+        explicit Handle(T* archive) : archive_(archive) { }
+        Handle(Handle&& other) noexcept : archive_(other.archive_) { other.archive_ = nullptr; }
+        Handle(const Handle& other) = delete;
+        ~Handle() { Release(); }
+
+        Handle& operator=(Handle&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Release();
+                archive_ = other.archive_;
+                other.archive_ = nullptr;
+            }
+            return *this;
+        }
+        Handle& operator=(const Handle& other) = delete;
+
+        /// Returns pooled archive.
+        T* Get() const                                         { return archive_; }
+        /// Returns pooled archive.
+        T* operator->() const                                  { return archive_; }
+        /// Returns pooled archive.
+        T& operator*() const                                   { return *archive_; }
+        /// Returns true if handle holds an archive.
+        explicit operator bool() const                         { return archive_ != nullptr; }
+        /// Return archive to the pool early.
+        void Release()
+        {
+            if (archive_ != nullptr)
+                ArchivePool::Return(archive_);
+            archive_ = nullptr;
+        }
+
+    private:
+        /// Pooled archive.
+        T* archive_ = nullptr;
+    };
+
+    /// Returns an archive from the pool. New archive is constructed when pool is empty.
+    static Handle Acquire()
+    {
+        auto& local = GetLocal();
+        if (local.archives_.empty())
+        {
+            // Refill local list in batches, so that shared pool is locked rarely.
+            const size_t refill = localLimit_.load(std::memory_order_relaxed) / 2;
+            auto& shared = GetShared();
+            std::lock_guard<std::mutex> lock(shared.mutex_);
+            while (!shared.archives_.empty() && local.archives_.size() < refill)
+            {
+                local.archives_.push_back(shared.archives_.back());
+                shared.archives_.pop_back();
+            }
+        }
+
+        if (local.archives_.empty())
+            return Handle(new T(nullptr));
+
+        T* archive = local.archives_.back();
+        local.archives_.pop_back();
+        return Handle(archive);
+    }
+
+    /// Construct archives in advance, so that calling thread does not construct them when serving requests.
+    static void Warm(size_t count)
+    {
+        auto& local = GetLocal();
+        while (local.archives_.size() < count && local.archives_.size() < localLimit_.load(std::memory_order_relaxed))
+            local.archives_.push_back(new T(nullptr));
+    }
+
+    /// Set max number of archives kept in free list of each thread and in shared pool. Excess archives of calling
+    /// thread are moved to shared pool and excess archives of shared pool are destroyed. Free lists of other threads
+    /// are trimmed when archives are returned to them.
+    static void SetLimits(size_t local, size_t shared)
+    {
+        localLimit_.store(local, std::memory_order_relaxed);
+        sharedLimit_.store(shared, std::memory_order_relaxed);
+        TrimLocal(GetLocal());
+
+        std::vector<T*> excess;
+        {
+            auto& pool = GetShared();
+            std::lock_guard<std::mutex> lock(pool.mutex_);
+            while (pool.archives_.size() > shared)
+            {
+                excess.push_back(pool.archives_.back());
+                pool.archives_.pop_back();
+            }
+        }
+        for (T* archive : excess)
+            delete archive;
+    }
+
+private:
+    /// Free list of a thread. Remaining archives are moved to shared pool when thread exits.
+    struct LocalList
+    {
+        LocalList() { archives_.reserve(localLimit_.load(std::memory_order_relaxed)); }
+        ~LocalList()
+        {
+            while (!archives_.empty())
+            {
+                ReturnShared(archives_.back());
+                archives_.pop_back();
+            }
+        }
+
+        std::vector<T*> archives_;
+    };
+
+    /// Pool shared between threads.
+    struct SharedPool
+    {
+        ~SharedPool()
+        {
+            for (T* archive : archives_)
+                delete archive;
+        }
+
+        std::mutex mutex_;
+        std::vector<T*> archives_;
+    };
+
+    static LocalList& GetLocal()
+    {
+        static thread_local LocalList local;
+        return local;
+    }
+
+    static SharedPool& GetShared()
+    {
+        static SharedPool shared;
+        return shared;
+    }
+
+    /// Reset archive and put it into free list of calling thread, or into shared pool if free list is full.
+    static void Return(T* archive)
+    {
+        archive->Reset();
+
+        auto& local = GetLocal();
+        if (local.archives_.size() < localLimit_.load(std::memory_order_relaxed))
+            local.archives_.push_back(archive);
+        else
+        {
+            ReturnShared(archive);
+            TrimLocal(local);
+        }
+    }
+
+    /// Move archives in excess of the limit from specified free list to shared pool.
+    static void TrimLocal(LocalList& local)
+    {
+        while (local.archives_.size() > localLimit_.load(std::memory_order_relaxed))
+        {
+            ReturnShared(local.archives_.back());
+            local.archives_.pop_back();
+        }
+    }
+
+    /// Put archive into shared pool or destroy it if shared pool is full.
+    static void ReturnShared(T* archive)
+    {
+        auto& shared = GetShared();
+        {
+            std::lock_guard<std::mutex> lock(shared.mutex_);
+            if (shared.archives_.size() < sharedLimit_.load(std::memory_order_relaxed))
+            {
+                shared.archives_.push_back(archive);
+                return;
+            }
+        }
+        delete archive;
+    }
+
+    /// Max number of archives in free list of each thread. Atomic, because limits may be changed while other threads
+    /// use the pool.
+    static std::atomic<size_t> localLimit_;
+    /// Max number of archives in shared pool.
+    static std::atomic<size_t> sharedLimit_;
+};
+
+template<typename T>
+std::atomic<size_t> ArchivePool<T>::localLimit_{16};
+
+template<typename T>
+std::atomic<size_t> ArchivePool<T>::sharedLimit_{64};
+
+}   // namespace ser
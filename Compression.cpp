@@ -0,0 +1,546 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <algorithm>
+#include <cstring>
+#include "Compression.h"
+
+
+namespace ser
+{
+
+// Shortest match LZ4 can encode.
+static const size_t Compression__MinMatch = 4;
+// Last bytes of a block are always literals.
+static const size_t Compression__LastLiterals = 5;
+// Last match must start this many bytes before end of block.
+static const size_t Compression__MatchFindLimit = 12;
+// Farthest distance of a match.
+static const size_t Compression__MaxOffset = 65535;
+// Size of history linked blocks may refer to.
+static const size_t Compression__WindowSize = 64 * 1024;
+static const unsigned Compression__HashLog = 12;
+static const uint32_t Compression__FrameMagic = 0x184D2204;
+static const uint32_t Compression__SkippableMagic = 0x184D2A50;
+static const uint32_t Compression__UncompressedFlag = 0x80000000u;
+static const size_t Compression__Error = (size_t)-1;
+
+// Frame descriptor flags.
+static const uint8_t Compression__FlagVersion = 0x40;
+static const uint8_t Compression__FlagIndependent = 0x20;
+static const uint8_t Compression__FlagBlockChecksum = 0x10;
+static const uint8_t Compression__FlagContentSize = 0x08;
+static const uint8_t Compression__FlagContentChecksum = 0x04;
+static const uint8_t Compression__FlagDictionary = 0x01;
+
+static uint32_t Compression__Read32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t Compression__ReadLE32(const char* data)
+{
+    return (uint32_t)(uint8_t)data[0] | (uint32_t)(uint8_t)data[1] << 8 | (uint32_t)(uint8_t)data[2] << 16 |
+        (uint32_t)(uint8_t)data[3] << 24;
+}
+
+static void Compression__WriteLE32(char* data, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        data[i] = (char)((value >> (i * 8)) & 0xFF);
+}
+
+static uint32_t Compression__Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - Compression__HashLog);
+}
+
+static uint32_t Compression__Rotl(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// XXH32 with seed 0 of fewer than 16 bytes, which covers every frame descriptor. Header checksum is its second byte.
+static uint8_t Compression__HeaderChecksum(const uint8_t* data, size_t size)
+{
+    const uint32_t prime1 = 2654435761u, prime2 = 2246822519u, prime3 = 3266489917u, prime4 = 668265263u,
+        prime5 = 374761393u;
+    uint32_t hash = prime5 + (uint32_t)size;
+    for (; size >= 4; data += 4, size -= 4)
+    {
+        hash += ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24) * prime3;
+        hash = Compression__Rotl(hash, 17) * prime4;
+    }
+    for (; size > 0; data++, size--)
+    {
+        hash += *data * prime5;
+        hash = Compression__Rotl(hash, 11) * prime1;
+    }
+    hash ^= hash >> 15;
+    hash *= prime2;
+    hash ^= hash >> 13;
+    hash *= prime3;
+    hash ^= hash >> 16;
+    return (uint8_t)(hash >> 8);
+}
+
+// Write part of a length that does not fit into its token nibble.
+static uint8_t* Compression__WriteLength(uint8_t* output, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        *output++ = 255;
+    *output++ = (uint8_t)length;
+    return output;
+}
+
+// Write a sequence of literals followed by a match, or literals alone if match length is 0. Returns null if sequence
+// does not fit.
+static uint8_t* Compression__WriteSequence(uint8_t* output, uint8_t* outputEnd, const uint8_t* literals,
+    size_t literalLength, size_t offset, size_t matchLength)
+{
+    const size_t needed = 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1;
+    if ((size_t)(outputEnd - output) < needed)
+        return nullptr;
+
+    uint8_t* token = output++;
+    *token = (uint8_t)(std::min<size_t>(literalLength, 15) << 4);
+    if (literalLength >= 15)
+        output = Compression__WriteLength(output, literalLength - 15);
+    memcpy(output, literals, literalLength);
+    output += literalLength;
+    if (matchLength == 0)
+        return output;
+
+    *output++ = (uint8_t)(offset & 0xFF);
+    *output++ = (uint8_t)(offset >> 8);
+    const size_t length = matchLength - Compression__MinMatch;
+    *token |= (uint8_t)std::min<size_t>(length, 15);
+    if (length >= 15)
+        output = Compression__WriteLength(output, length - 15);
+    return output;
+}
+
+// Greedy single-probe compressor, same strategy as LZ4 fast mode. Table holds positions relative to beginning of
+// source. Entries left over from previous blocks are harmless, every candidate is verified against source.
+static size_t Compression__Compress(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity,
+    uint32_t* table)
+{
+    const uint8_t* end = source + size;
+    const uint8_t* anchor = source;
+    uint8_t* output = destination;
+    uint8_t* outputEnd = destination + capacity;
+
+    if (size > Compression__MatchFindLimit)
+    {
+        const uint8_t* matchFindLimit = end - Compression__MatchFindLimit;
+        const uint8_t* matchLimit = end - Compression__LastLiterals;
+        table[Compression__Hash(Compression__Read32(source))] = 0;
+        const uint8_t* input = source + 1;
+        size_t misses = 0;
+        while (input < matchFindLimit)
+        {
+            const uint32_t sequence = Compression__Read32(input);
+            const uint32_t hash = Compression__Hash(sequence);
+            const size_t position = table[hash];
+            table[hash] = (uint32_t)(input - source);
+            const uint8_t* match = source + position;
+            if (position >= (size_t)(input - source) || (size_t)(input - match) > Compression__MaxOffset ||
+                Compression__Read32(match) != sequence)
+            {
+                // Incompressible data is skipped faster the longer no match is found
+                input += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            while (input > anchor && match > source && input[-1] == match[-1])
+            {
+                input--;
+                match--;
+            }
+            const uint8_t* matchEnd = input + Compression__MinMatch;
+            const uint8_t* reference = match + Compression__MinMatch;
+            while (matchEnd < matchLimit && *matchEnd == *reference)
+            {
+                matchEnd++;
+                reference++;
+            }
+
+            output = Compression__WriteSequence(output, outputEnd, anchor, (size_t)(input - anchor),
+                (size_t)(input - match), (size_t)(matchEnd - input));
+            if (output == nullptr)
+                return 0;
+
+            input = matchEnd;
+            anchor = input;
+            if (input < matchFindLimit)
+                table[Compression__Hash(Compression__Read32(input - 2))] = (uint32_t)(input - 2 - source);
+        }
+    }
+
+    output = Compression__WriteSequence(output, outputEnd, anchor, (size_t)(end - anchor), 0, 0);
+    return output != nullptr ? (size_t)(output - destination) : 0;
+}
+
+// Decompress block into [output, outputEnd). Matches may refer to history that precedes output, down to base.
+static size_t Compression__Decompress(const uint8_t* input, size_t size, const uint8_t* base, uint8_t* output,
+    uint8_t* outputEnd)
+{
+    const uint8_t* inputEnd = input + size;
+    uint8_t* begin = output;
+    for (;;)
+    {
+        if (input >= inputEnd)
+            return Compression__Error;
+        const unsigned token = *input++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15)
+        {
+            uint8_t byte;
+            do
+            {
+                if (input >= inputEnd)
+                    return Compression__Error;
+                byte = *input++;
+                literalLength += byte;
+            } while (byte == 255);
+        }
+        if ((size_t)(inputEnd - input) < literalLength || (size_t)(outputEnd - output) < literalLength)
+            return Compression__Error;
+        memcpy(output, input, literalLength);
+        output += literalLength;
+        input += literalLength;
+
+        // Last sequence has no match
+        if (input == inputEnd)
+            return (size_t)(output - begin);
+
+        if (inputEnd - input < 2)
+            return Compression__Error;
+        const size_t offset = (size_t)input[0] | (size_t)input[1] << 8;
+        input += 2;
+        if (offset == 0 || offset > (size_t)(output - base))
+            return Compression__Error;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15)
+        {
+            uint8_t byte;
+            do
+            {
+                if (input >= inputEnd)
+                    return Compression__Error;
+                byte = *input++;
+                matchLength += byte;
+            } while (byte == 255);
+        }
+        matchLength += Compression__MinMatch;
+        if ((size_t)(outputEnd - output) < matchLength)
+            return Compression__Error;
+
+        // Overlapping match repeats its beginning, therefore it is copied byte by byte
+        const uint8_t* match = output - offset;
+        if (offset >= matchLength)
+            memcpy(output, match, matchLength);
+        else
+        {
+            for (size_t i = 0; i < matchLength; i++)
+                output[i] = match[i];
+        }
+        output += matchLength;
+    }
+}
+
+size_t LZ4CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t LZ4CompressBlock(const void* source, size_t size, void* destination, size_t capacity)
+{
+    std::vector<uint32_t> table(1u << Compression__HashLog);
+    return Compression__Compress(static_cast<const uint8_t*>(source), size, static_cast<uint8_t*>(destination),
+        capacity, table.data());
+}
+
+size_t LZ4DecompressBlock(const void* source, size_t size, void* destination, size_t capacity)
+{
+    auto* output = static_cast<uint8_t*>(destination);
+    return Compression__Decompress(static_cast<const uint8_t*>(source), size, output, output, output + capacity);
+}
+
+// ---------------------- CompressingSink ----------------------
+
+CompressingSink::CompressingSink(Sink& target, size_t blockSize)
+    : target_(target)
+    , table_(1u << Compression__HashLog)
+{
+    // Block maximum size codes 4-7 stand for 64 KB, 256 KB, 1 MB and 4 MB
+    unsigned code = 4;
+    while (code < 7 && ((size_t)1 << (2 * code + 8)) < blockSize)
+        code++;
+    blockSize_ = (size_t)1 << (2 * code + 8);
+    blockDescriptor_ = (uint8_t)(code << 4);
+    block_.reserve(blockSize_);
+    compressed_.resize(4 + LZ4CompressBound(blockSize_));
+}
+
+CompressingSink::~CompressingSink()
+{
+    if (inFrame_)
+        Finish();
+}
+
+bool CompressingSink::Write(const void* data, size_t size)
+{
+    BeginFrame();
+    auto* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        const size_t part = std::min(size, blockSize_ - block_.size());
+        block_.insert(block_.end(), bytes, bytes + part);
+        bytes += part;
+        size -= part;
+        if (block_.size() == blockSize_)
+            WriteBlock();
+    }
+    return written_;
+}
+
+bool CompressingSink::Flush()
+{
+    WriteBlock();
+    const bool flushed = target_.Flush();
+    return flushed && written_;
+}
+
+bool CompressingSink::Finish()
+{
+    BeginFrame();
+    WriteBlock();
+    char endMark[4] = {};
+    written_ = target_.Write(endMark, sizeof(endMark)) && written_;
+    inFrame_ = false;
+    return written_;
+}
+
+void CompressingSink::BeginFrame()
+{
+    if (inFrame_)
+        return;
+
+    char header[7];
+    Compression__WriteLE32(header, Compression__FrameMagic);
+    header[4] = (char)(Compression__FlagVersion | Compression__FlagIndependent);
+    header[5] = (char)blockDescriptor_;
+    header[6] = (char)Compression__HeaderChecksum(reinterpret_cast<const uint8_t*>(header + 4), 2);
+    written_ = target_.Write(header, sizeof(header)) && written_;
+    inFrame_ = true;
+}
+
+void CompressingSink::WriteBlock()
+{
+    if (block_.empty())
+        return;
+
+    // Blocks that do not shrink are stored as they are
+    auto* output = reinterpret_cast<uint8_t*>(compressed_.data() + 4);
+    const size_t size = Compression__Compress(reinterpret_cast<const uint8_t*>(block_.data()), block_.size(), output,
+        block_.size() - 1, table_.data());
+    if (size > 0)
+    {
+        Compression__WriteLE32(compressed_.data(), (uint32_t)size);
+        written_ = target_.Write(compressed_.data(), 4 + size) && written_;
+    }
+    else
+    {
+        Compression__WriteLE32(compressed_.data(), (uint32_t)block_.size() | Compression__UncompressedFlag);
+        written_ = target_.Write(compressed_.data(), 4) && written_;
+        written_ = target_.Write(block_.data(), block_.size()) && written_;
+    }
+    block_.clear();
+}
+
+// ---------------------- DecompressingSink ----------------------
+
+bool DecompressingSink::Write(const void* data, size_t size)
+{
+    auto* input = static_cast<const char*>(data);
+    auto* end = input + size;
+    while (!failed_ && input < end)
+    {
+        const char* bytes = Gather(input, end, expected_);
+        if (bytes == nullptr)
+            break;
+
+        switch (stage_)
+        {
+        case Magic:
+        {
+            const uint32_t magic = Compression__ReadLE32(bytes);
+            if (magic == Compression__FrameMagic)
+            {
+                stage_ = Descriptor;
+                expected_ = 2;
+            }
+            else if ((magic & 0xFFFFFFF0u) == Compression__SkippableMagic)
+            {
+                stage_ = SkippableSize;
+                expected_ = 4;
+            }
+            else
+                failed_ = true;
+            break;
+        }
+        case Descriptor:
+        {
+            flags_ = (uint8_t)bytes[0];
+            const unsigned code = ((uint8_t)bytes[1] >> 4) & 7;
+            if ((flags_ & 0xC2) != Compression__FlagVersion || ((uint8_t)bytes[1] & 0x8F) != 0 || code < 4)
+            {
+                failed_ = true;
+                break;
+            }
+            blockSize_ = (size_t)1 << (2 * code + 8);
+            descriptor_[0] = bytes[0];
+            descriptor_[1] = bytes[1];
+            stage_ = DescriptorRest;
+            expected_ = ((flags_ & Compression__FlagContentSize) != 0 ? 8 : 0) +
+                ((flags_ & Compression__FlagDictionary) != 0 ? 4 : 0) + 1;
+            break;
+        }
+        case DescriptorRest:
+            memcpy(descriptor_ + 2, bytes, expected_ - 1);
+            if ((uint8_t)bytes[expected_ - 1] !=
+                Compression__HeaderChecksum(reinterpret_cast<const uint8_t*>(descriptor_), expected_ + 1))
+            {
+                failed_ = true;
+                break;
+            }
+            history_ = 0;
+            stage_ = BlockHeader;
+            expected_ = 4;
+            break;
+        case BlockHeader:
+            blockHeader_ = Compression__ReadLE32(bytes);
+            if (blockHeader_ == 0)
+            {
+                stage_ = (flags_ & Compression__FlagContentChecksum) != 0 ? ContentChecksum : Magic;
+                expected_ = 4;
+            }
+            else if ((blockHeader_ & ~Compression__UncompressedFlag) > blockSize_)
+                failed_ = true;
+            else
+            {
+                stage_ = Block;
+                expected_ = (blockHeader_ & ~Compression__UncompressedFlag) +
+                    ((flags_ & Compression__FlagBlockChecksum) != 0 ? 4 : 0);
+            }
+            break;
+        case Block:
+            failed_ = !DecodeBlock(bytes, blockHeader_ & ~Compression__UncompressedFlag,
+                (blockHeader_ & Compression__UncompressedFlag) == 0);
+            stage_ = BlockHeader;
+            expected_ = 4;
+            break;
+        case ContentChecksum:
+            stage_ = Magic;
+            expected_ = 4;
+            break;
+        case SkippableSize:
+            expected_ = Compression__ReadLE32(bytes);
+            stage_ = expected_ > 0 ? Skippable : Magic;
+            if (expected_ == 0)
+                expected_ = 4;
+            break;
+        case Skippable:
+            stage_ = Magic;
+            expected_ = 4;
+            break;
+        }
+        pending_.clear();
+    }
+    return !failed_;
+}
+
+bool DecompressingSink::Flush()
+{
+    const bool flushed = target_.Flush();
+    return flushed && !failed_;
+}
+
+const char* DecompressingSink::Gather(const char*& data, const char* end, size_t count)
+{
+    if (pending_.empty() && (size_t)(end - data) >= count)
+    {
+        const char* result = data;
+        data += count;
+        return result;
+    }
+
+    const size_t part = std::min(count - pending_.size(), (size_t)(end - data));
+    pending_.insert(pending_.end(), data, data + part);
+    data += part;
+    return pending_.size() == count ? pending_.data() : nullptr;
+}
+
+bool DecompressingSink::DecodeBlock(const char* data, size_t size, bool compressed)
+{
+    const bool linked = (flags_ & Compression__FlagIndependent) == 0;
+    if (!linked)
+        history_ = 0;
+
+    window_.resize(history_ + blockSize_);
+    auto* base = reinterpret_cast<uint8_t*>(window_.data());
+    auto* output = base + history_;
+    size_t decompressed = size;
+    if (compressed)
+        decompressed = Compression__Decompress(reinterpret_cast<const uint8_t*>(data), size, base, output,
+            output + blockSize_);
+    else
+        memcpy(output, data, size);
+
+    if (decompressed == Compression__Error || !target_.Write(output, decompressed))
+        return false;
+
+    // Linked blocks may refer to last 64 KB of output
+    if (linked)
+    {
+        const size_t total = history_ + decompressed;
+        history_ = std::min(total, Compression__WindowSize);
+        memmove(window_.data(), window_.data() + total - history_, history_);
+    }
+    return true;
+}
+
+bool LZ4DecompressFrames(const void* data, size_t size, std::string& result)
+{
+    StringSink output;
+    DecompressingSink decompressor(output);
+    const bool decompressed = decompressor.Write(data, size) && decompressor.IsComplete();
+    result = output.Take();
+    return decompressed;
+}
+
+}   // namespace ser
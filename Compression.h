@@ -0,0 +1,151 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Sink.h"
+
+
+namespace ser
+{
+
+/// Returns largest possible size of LZ4 block compressed from specified amount of bytes.
+size_t LZ4CompressBound(size_t size);
+/// Compress specified bytes into a single LZ4 block. Returns size of compressed block, or 0 if it does not fit into
+/// destination. Destination of LZ4CompressBound() bytes is always large enough.
+size_t LZ4CompressBlock(const void* source, size_t size, void* destination, size_t capacity);
+/// Decompress a single LZ4 block. Returns size of decompressed data, or -1 if block is malformed or does not fit into
+/// destination.
+size_t LZ4DecompressBlock(const void* source, size_t size, void* destination, size_t capacity);
+
+/// Compresses output into LZ4 frames and writes them to another sink. Frames are compatible with the lz4 tool and
+/// library: blocks are independent and carry no checksums. Output is buffered and compressed one block at a time, so
+/// archives can be saved compressed in a single pass.
+class CompressingSink : public Sink
+{
+public:
+    /// Construct sink writing to specified target. Block size is rounded up to one of sizes allowed by the frame format:
+    /// 64 KB, 256 KB, 1 MB or 4 MB. Target must outlive the sink.
+    explicit CompressingSink(Sink& target, size_t blockSize = 64 * 1024);
+    CompressingSink(const CompressingSink& other) = delete;
+    CompressingSink& operator=(const CompressingSink& other) = delete;
+    /// Finish current frame.
+    ~CompressingSink() override;
+
+    bool Write(const void* data, size_t size) override;
+    /// Compress buffered output into a block, write it and flush target. Frame stays open.
+    bool Flush() override;
+    /// Write buffered output and end mark of current frame. Next Write() starts a new frame.
+    bool Finish();
+
+private:
+    /// Write frame header unless it was written already.
+    void BeginFrame();
+    /// Compress buffered output into a block and write it.
+    void WriteBlock();
+
+    /// Sink compressed output is written to.
+    Sink& target_;
+    /// Largest amount of bytes in a block.
+    size_t blockSize_ = 0;
+    /// Block descriptor byte of frame header.
+    uint8_t blockDescriptor_ = 0;
+    /// Output waiting to be compressed.
+    std::vector<char> block_;
+    /// Compressed block, prefixed by its size.
+    std::vector<char> compressed_;
+    /// Positions of recently seen sequences, reused between blocks.
+    std::vector<uint32_t> table_;
+    /// True if header of current frame was written.
+    bool inFrame_ = false;
+    /// False if target failed to write.
+    bool written_ = true;
+};
+
+/// Decompresses LZ4 frames written to it and writes decompressed output to another sink. Input may be split at any
+/// byte and may contain multiple frames. Frames with linked blocks, checksums, content size and skippable frames are
+/// accepted, checksums are not verified.
+class DecompressingSink : public Sink
+{
+public:
+    /// Construct sink writing to specified target. Target must outlive the sink.
+    explicit DecompressingSink(Sink& target) : target_(target) { }
+
+    /// Decompress specified part of input. Returns false once input is malformed or target failed to write.
+    bool Write(const void* data, size_t size) override;
+    bool Flush() override;
+    /// Returns true if input ended at a frame boundary.
+    bool IsComplete() const { return stage_ == Magic && pending_.empty() && !failed_; }
+
+private:
+    /// Part of input decoder waits for.
+    enum Stage
+    {
+        Magic,
+        Descriptor,
+        DescriptorRest,
+        BlockHeader,
+        Block,
+        ContentChecksum,
+        SkippableSize,
+        Skippable,
+    };
+
+    /// Return pointer to next count bytes of input, either in place or gathered into pending_ from multiple writes.
+    /// Returns null if input ended before count bytes were available.
+    const char* Gather(const char*& data, const char* end, size_t count);
+    /// Decompress block and write it to target.
+    bool DecodeBlock(const char* data, size_t size, bool compressed);
+
+    /// Sink decompressed output is written to.
+    Sink& target_;
+    /// Part of input decoder waits for.
+    Stage stage_ = Magic;
+    /// Input of current stage gathered so far.
+    std::vector<char> pending_;
+    /// Size of data expected by current stage.
+    size_t expected_ = 4;
+    /// Frame descriptor flags.
+    uint8_t flags_ = 0;
+    /// Frame descriptor, which header checksum is computed from.
+    char descriptor_[14] = {};
+    /// Largest block size of current frame.
+    size_t blockSize_ = 0;
+    /// Size of current block including its checksum.
+    uint32_t blockHeader_ = 0;
+    /// Recent decompressed output which linked blocks refer to, followed by space for decompressed block.
+    std::vector<char> window_;
+    /// Amount of recent output in window_.
+    size_t history_ = 0;
+    /// True once input was malformed or target failed to write.
+    bool failed_ = false;
+};
+
+/// Decompress all LZ4 frames in specified memory into result. Returns false if input is malformed or ends in the middle
+/// of a frame.
+bool LZ4DecompressFrames(const void* data, size_t size, std::string& result);
+
+}   // namespace ser
@@ -0,0 +1,382 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "HashArchive.h"
+
+namespace ser
+{
+
+// ---------------------- XXH64State ----------------------
+
+static const uint64_t HashArchive__Prime1 = 11400714785074694791ull;
+static const uint64_t HashArchive__Prime2 = 14029467366897019727ull;
+static const uint64_t HashArchive__Prime3 = 1609587929392839161ull;
+static const uint64_t HashArchive__Prime4 = 9650029242287828579ull;
+static const uint64_t HashArchive__Prime5 = 2870177450012600261ull;
+
+static uint64_t HashArchive__Rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t HashArchive__ReadLE64(const unsigned char* data)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+        value = value << 8 | data[i];
+    return value;
+}
+
+static uint64_t HashArchive__Round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * HashArchive__Prime2;
+    return HashArchive__Rotl(accumulator, 31) * HashArchive__Prime1;
+}
+
+static uint64_t HashArchive__Merge(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= HashArchive__Round(0, accumulator);
+    return hash * HashArchive__Prime1 + HashArchive__Prime4;
+}
+
+void detail::XXH64State::Reset(uint64_t seed)
+{
+    accumulators_[0] = seed + HashArchive__Prime1 + HashArchive__Prime2;
+    accumulators_[1] = seed + HashArchive__Prime2;
+    accumulators_[2] = seed;
+    accumulators_[3] = seed - HashArchive__Prime1;
+    buffered_ = 0;
+    total_ = 0;
+    seed_ = seed;
+}
+
+void detail::XXH64State::Update(const void* data, size_t size)
+{
+    auto* input = static_cast<const unsigned char*>(data);
+    total_ += size;
+
+    // Most updates are small events which only fill the buffer
+    if (buffered_ + size < sizeof(buffer_))
+    {
+        memcpy(buffer_ + buffered_, input, size);
+        buffered_ += size;
+        return;
+    }
+
+    if (buffered_ > 0)
+    {
+        const size_t fill = sizeof(buffer_) - buffered_;
+        memcpy(buffer_ + buffered_, input, fill);
+        for (int lane = 0; lane < 4; lane++)
+            accumulators_[lane] = HashArchive__Round(accumulators_[lane], HashArchive__ReadLE64(buffer_ + lane * 8));
+        input += fill;
+        size -= fill;
+        buffered_ = 0;
+    }
+
+    for (; size >= sizeof(buffer_); input += sizeof(buffer_), size -= sizeof(buffer_))
+    {
+        for (int lane = 0; lane < 4; lane++)
+            accumulators_[lane] = HashArchive__Round(accumulators_[lane], HashArchive__ReadLE64(input + lane * 8));
+    }
+
+    memcpy(buffer_, input, size);
+    buffered_ = size;
+}
+
+uint64_t detail::XXH64State::Digest() const
+{
+    uint64_t hash;
+    if (total_ >= sizeof(buffer_))
+    {
+        hash = HashArchive__Rotl(accumulators_[0], 1) + HashArchive__Rotl(accumulators_[1], 7) +
+            HashArchive__Rotl(accumulators_[2], 12) + HashArchive__Rotl(accumulators_[3], 18);
+        for (auto accumulator : accumulators_)
+            hash = HashArchive__Merge(hash, accumulator);
+    }
+    else
+        hash = seed_ + HashArchive__Prime5;
+    hash += total_;
+
+    const unsigned char* data = buffer_;
+    size_t size = buffered_;
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        hash ^= HashArchive__Round(0, HashArchive__ReadLE64(data));
+        hash = HashArchive__Rotl(hash, 27) * HashArchive__Prime1 + HashArchive__Prime4;
+    }
+    if (size >= 4)
+    {
+        const uint64_t word = (uint64_t)data[0] | (uint64_t)data[1] << 8 | (uint64_t)data[2] << 16 |
+            (uint64_t)data[3] << 24;
+        hash ^= word * HashArchive__Prime1;
+        hash = HashArchive__Rotl(hash, 23) * HashArchive__Prime2 + HashArchive__Prime3;
+        data += 4;
+        size -= 4;
+    }
+    for (; size > 0; data++, size--)
+    {
+        hash ^= *data * HashArchive__Prime5;
+        hash = HashArchive__Rotl(hash, 11) * HashArchive__Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= HashArchive__Prime2;
+    hash ^= hash >> 29;
+    hash *= HashArchive__Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// ---------------------- HashArchive::Iterator ----------------------
+
+// Kinds of hashed events. Each event is hashed as its kind, depth of its container, whether it is keyed, index or key
+// hash of its element and a payload. Depths make nesting unambiguous without hashing ends of containers.
+static const char HashArchive__ArrayEvent = 'A';
+static const char HashArchive__MapEvent = 'M';
+static const char HashArchive__BoolEvent = 'b';
+static const char HashArchive__SignedEvent = 'i';
+static const char HashArchive__UnsignedEvent = 'u';
+static const char HashArchive__FloatEvent = 'f';
+static const char HashArchive__StringEvent = 's';
+
+static unsigned char* HashArchive__WriteLE(unsigned char* data, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        data[i] = (unsigned char)(value >> (i * 8));
+    return data + bytes;
+}
+
+HashArchive::Iterator::Iterator(HashArchive* archive, unsigned depth, bool keyed, uint64_t selector)
+    : archive_(archive)
+    , depth_(depth)
+    , keyed_(keyed)
+    , selector_(selector)
+{
+}
+
+void HashArchive::Iterator::Copy(ArchiveIterator& destination) const
+{
+    ArchiveIterator::Construct<Iterator>(destination, *this);
+}
+
+ArchiveIterator HashArchive::Iterator::operator[](int index)
+{
+    if (archive_ == nullptr || index < 0)
+        return {};
+    return ArchiveIterator::ConstructR<Iterator>(archive_, depth_, false, (uint64_t)index);
+}
+
+void HashArchive::Iterator::operator++()
+{
+    // Iterating a map continues with indices, same as archives that store maps as arrays of values
+    if (keyed_)
+    {
+        keyed_ = false;
+        selector_ = 0;
+    }
+    selector_++;
+}
+
+ArchiveIterator HashArchive::Iterator::Find(const std::string& key)
+{
+    if (archive_ == nullptr)
+        return {};
+
+    detail::XXH64State keyHash(archive_->seed_);
+    keyHash.Update(key.data(), key.size());
+    return ArchiveIterator::ConstructR<Iterator>(archive_, depth_, true, keyHash.Digest());
+}
+
+void HashArchive::Iterator::Write(char kind, const void* payload, size_t size) const
+{
+    unsigned char event[1 + 4 + 1 + 8 + 8];
+    auto* end = event;
+    *end++ = (unsigned char)kind;
+    end = HashArchive__WriteLE(end, depth_, 4);
+    *end++ = keyed_ ? 1 : 0;
+    end = HashArchive__WriteLE(end, selector_, 8);
+    if (size > 0)
+        memcpy(end, payload, size);
+    archive_->state_.Update(event, (size_t)(end - event) + size);
+}
+
+// ---------------------- HashArchive ----------------------
+
+HashArchive::HashArchive(uint64_t seed)
+    : state_(seed)
+    , seed_(seed)
+{
+}
+
+void HashArchive::Reset(size_t /*highWaterMark*/)
+{
+    state_.Reset(seed_);
+}
+
+ArchiveIterator HashArchive::Begin(ContainerType type)
+{
+    // Root is the only element of a virtual container at depth 0
+    Iterator root(this, 0, false, 0);
+    root.Write(type == Array ? HashArchive__ArrayEvent : HashArchive__MapEvent, nullptr, 0);
+    auto result = ArchiveIterator::ConstructR<Iterator>(this, 1u, false, (uint64_t)0);
+    TraceContainer(result, "root", 4);
+    return result;
+}
+
+ArchiveIterator HashArchive::Begin(ArchiveIterator&& it, ContainerType type)
+{
+    if (!it)
+        return {};
+
+    auto* parent = static_cast<Iterator*>(it.Get());   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    parent->Write(type == Array ? HashArchive__ArrayEvent : HashArchive__MapEvent, nullptr, 0);
+    auto result = ArchiveIterator::ConstructR<Iterator>(this, parent->depth_ + 1, false, (uint64_t)0);
+    TraceContainer(result, type == Array ? "array" : "map", type == Array ? 5 : 3);
+    return result;
+}
+
+bool HashArchive::SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& /*cache*/)
+{
+    return Serialize((ArchiveIterator&&)it, typeId, value);
+}
+
+// Integers are hashed by value, so that their width and signedness do not matter.
+static bool HashArchive__SerializeInteger(ArchiveIterator& it, int64_t value)
+{
+    if (!it)
+        return false;
+
+    unsigned char payload[8];
+    HashArchive__WriteLE(payload, (uint64_t)value, 8);
+    const char kind = value < 0 ? HashArchive__SignedEvent : HashArchive__UnsignedEvent;
+    static_cast<HashArchive::Iterator*>(it.Get())->Write(kind, payload, sizeof(payload));   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    return true;
+}
+
+static bool HashArchive__SerializeUnsigned(ArchiveIterator& it, uint64_t value)
+{
+    if (!it)
+        return false;
+
+    unsigned char payload[8];
+    HashArchive__WriteLE(payload, value, 8);
+    static_cast<HashArchive::Iterator*>(it.Get())->Write(HashArchive__UnsignedEvent, payload, sizeof(payload));   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    return true;
+}
+
+// Floats are widened to double. Zeros and NaNs of all signs and payloads hash equally.
+static bool HashArchive__SerializeFloat(ArchiveIterator& it, double value)
+{
+    if (!it)
+        return false;
+
+    if (value == 0)
+        value = 0;
+    else if (std::isnan(value))
+        value = std::numeric_limits<double>::quiet_NaN();
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned char payload[8];
+    HashArchive__WriteLE(payload, bits, 8);
+    static_cast<HashArchive::Iterator*>(it.Get())->Write(HashArchive__FloatEvent, payload, sizeof(payload));   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    return true;
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, bool& value)
+{
+    if (!it)
+        return false;
+
+    const unsigned char payload = value ? 1 : 0;
+    static_cast<Iterator*>(it.Get())->Write(HashArchive__BoolEvent, &payload, 1);   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    return true;
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, int8_t& value)
+{
+    return HashArchive__SerializeInteger(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, uint8_t& value)
+{
+    return HashArchive__SerializeUnsigned(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, int16_t& value)
+{
+    return HashArchive__SerializeInteger(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, uint16_t& value)
+{
+    return HashArchive__SerializeUnsigned(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, int32_t& value)
+{
+    return HashArchive__SerializeInteger(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, uint32_t& value)
+{
+    return HashArchive__SerializeUnsigned(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, int64_t& value)
+{
+    return HashArchive__SerializeInteger(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, uint64_t& value)
+{
+    return HashArchive__SerializeUnsigned(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, float& value)
+{
+    return HashArchive__SerializeFloat(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, double& value)
+{
+    return HashArchive__SerializeFloat(it, value);
+}
+
+bool HashArchive::Serialize(ArchiveIterator&& it, std::string& value)
+{
+    if (!it)
+        return false;
+
+    // Length is a part of the event, so that adjacent strings can not be split differently
+    unsigned char payload[8];
+    HashArchive__WriteLE(payload, value.size(), 8);
+    auto* iterator = static_cast<Iterator*>(it.Get());   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    iterator->Write(HashArchive__StringEvent, payload, sizeof(payload));
+    state_.Update(value.data(), value.size());
+    return true;
+}
+
+}   // namespace ser
@@ -0,0 +1,147 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include "Archive.h"
+
+
+namespace ser
+{
+
+namespace detail
+{
+
+/// Streaming XXH64 hash.
+class XXH64State
+{
+public:
+    /// Start hashing with specified seed.
+    explicit XXH64State(uint64_t seed = 0) { Reset(seed); }
+
+    /// Discard hashed data and start over with specified seed.
+    void Reset(uint64_t seed = 0);
+    /// Hash specified bytes.
+    void Update(const void* data, size_t size);
+    /// Returns hash of all bytes so far. More bytes may be hashed afterwards.
+    uint64_t Digest() const;
+
+private:
+    /// Accumulators of stripes.
+    uint64_t accumulators_[4];
+    /// Bytes that do not make a whole stripe yet.
+    unsigned char buffer_[32];
+    /// Number of bytes in buffer_.
+    size_t buffered_ = 0;
+    /// Number of bytes hashed.
+    uint64_t total_ = 0;
+    /// Seed hash was started with.
+    uint64_t seed_ = 0;
+};
+
+}   // namespace detail
+
+/// Output archive which produces no document, but feeds structure and values straight into a 64-bit XXH64 hash.
+/// Hash depends only on content: containers, keys, indices and values in order they were serialized. Numbers are
+/// hashed by value, so that integers of any width and sign hash equally, same as floats and doubles. Hash does not
+/// depend on any output format. User types must register serializers of their own with
+/// SER_USER_TYPE_SERIALIZER(HashArchive, ...).
+class HashArchive : public Archive
+{
+public:
+    /// Position within a container. Begin() returns an iterator at first element of new container, operator[] and
+    /// Find() return iterators at specified element.
+    class Iterator : public detail::IArchiveIterator
+    {
+    protected:
+        void Copy(ArchiveIterator& destination) const override;
+        ArchiveIterator operator[](int index) override;
+        void operator++() override;
+
+    public:
+        Iterator(HashArchive* archive, unsigned depth, bool keyed, uint64_t selector);
+        Iterator(const Iterator& other) = default;
+
+        /// Returns 0, archive does not track sizes of containers.
+        int Size() const override { return 0; }
+        ArchiveIterator Find(const std::string& key) override;
+        /// Output containers can always be appended.
+        bool AtEnd() const override { return archive_ == nullptr; }
+
+        /// Hash an event of specified kind at this position, followed by specified payload.
+        void Write(char kind, const void* payload, size_t size) const;
+
+    protected:
+        friend class HashArchive;
+
+        HashArchive* archive_ = nullptr;
+        /// Depth of container this iterator points into, root container has depth 1.
+        unsigned depth_ = 0;
+        /// True if selector_ is hash of a key, otherwise it is an index.
+        bool keyed_ = false;
+        /// Index or hash of key of current element.
+        uint64_t selector_ = 0;
+    };
+    static_assert(sizeof(Iterator) <= ArchiveIterator::StorageSize, "ArchiveIterator::storage_ is too small.");
+private:
+    SER_USER_CONTAINER(HashArchive);
+public:
+    /// Construct archive which hashes with specified seed.
+    explicit HashArchive(uint64_t seed = 0);
+
+    /// Start hashing anew with the same seed.
+    void Reset(size_t highWaterMark = 0) override;
+    /// Returns hash of everything serialized since construction or last Reset(). Serialization may continue afterwards.
+    uint64_t GetHash() const { return state_.Digest(); }
+
+    /// Begin root container of specified type.
+    ArchiveIterator Begin(ContainerType type) override;
+    /// Begin container of specified type at specified position.
+    ArchiveIterator Begin(ArchiveIterator&& it, ContainerType type) override;
+
+    using Archive::SerializeCached;
+    /// Serialize user type. Hashing does not modify value, therefore cache is left intact.
+    bool SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& cache) override;
+
+    bool Serialize(ArchiveIterator&& it, bool& value) override;
+    bool Serialize(ArchiveIterator&& it, int8_t& value) override;
+    bool Serialize(ArchiveIterator&& it, uint8_t& value) override;
+    bool Serialize(ArchiveIterator&& it, int16_t& value) override;
+    bool Serialize(ArchiveIterator&& it, uint16_t& value) override;
+    bool Serialize(ArchiveIterator&& it, int32_t& value) override;
+    bool Serialize(ArchiveIterator&& it, uint32_t& value) override;
+    bool Serialize(ArchiveIterator&& it, int64_t& value) override;
+    bool Serialize(ArchiveIterator&& it, uint64_t& value) override;
+    bool Serialize(ArchiveIterator&& it, float& value) override;
+    bool Serialize(ArchiveIterator&& it, double& value) override;
+    bool Serialize(ArchiveIterator&& it, std::string& value) override;
+
+protected:
+    /// Hash state.
+    detail::XXH64State state_;
+    /// Seed of hash.
+    uint64_t seed_ = 0;
+};
+
+}   // namespace ser
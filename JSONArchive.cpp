@@ -19,19 +19,885 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 // DEALINGS IN THE SOFTWARE.
 //
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "rapidjson/memorystream.h"
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/stringbuffer.h"
 #include "JSONArchive.h"
+#include "Parallel.h"
+#include "Path.h"
+#include "Profiler.h"
+#include "Tracer.h"
 
 namespace ser
 {
 
+// ---------------------- JSONArchive ----------------------
+
+// Size of document memory chunks allocated from resource.
+static const size_t JSONArchive__ChunkSize = 64 * 1024;
+
+JSONArchive::JSONArchive(MemoryResource* resource)
+    : baseAllocator_(resource, &memoryStats_)
+    , allocator_(JSONArchive__ChunkSize, &baseAllocator_)
+    , index_(detail::ArchiveAllocator<std::pair<const Value* const, ObjectIndex>>(&baseAllocator_))
+    , root_(&allocator_, 1024, &baseAllocator_)
+{
+}
+
+JSONArchive::JSONArchive(void* buffer, size_t size, MemoryResource* resource)
+    : baseAllocator_(resource, &memoryStats_)
+    , initialBuffer_(buffer)
+    , initialBufferSize_(size)
+    , allocator_(buffer, size, JSONArchive__ChunkSize, &baseAllocator_)
+    , index_(detail::ArchiveAllocator<std::pair<const Value* const, ObjectIndex>>(&baseAllocator_))
+    , root_(&allocator_, 1024, &baseAllocator_)
+{
+}
+
+void JSONArchive::Reset(size_t highWaterMark)
+{
+    // Allocator capacity exceeds retained memory only if it had to allocate more chunks. In that case retain enough
+    // space for all data allocated so far, plus header of a chunk.
+    const size_t retained = bufferSize_ > initialBufferSize_ ? bufferSize_ : initialBufferSize_;
+    size_t size = allocator_.Capacity() > retained ? allocator_.Capacity() + 64 : retained;
+    if (highWaterMark > 0 && size > highWaterMark)
+        size = highWaterMark;
+
+    // Values do not own memory, allocator frees chunks except user-supplied buffer.
+    index_.clear();
+    root_.SetNull();
+    ReleaseFragments();
+    allocator_.~Allocator();
+
+    if (size > retained)
+    {
+        buffer_.reset(size > 64 ? static_cast<char*>(detail::Allocate(baseAllocator_.resource_, size, &memoryStats_)) : nullptr);
+        bufferSize_ = buffer_ ? size : 0;
+    }
+    else if (highWaterMark > 0 && bufferSize_ > highWaterMark)
+    {
+        buffer_.reset();
+        bufferSize_ = 0;
+    }
+
+    if (buffer_ && bufferSize_ > initialBufferSize_)
+        new(&allocator_) Allocator(buffer_.get(), bufferSize_, JSONArchive__ChunkSize, &baseAllocator_);
+    else if (initialBuffer_ != nullptr)
+        new(&allocator_) Allocator(initialBuffer_, initialBufferSize_, JSONArchive__ChunkSize, &baseAllocator_);
+    else
+        new(&allocator_) Allocator(JSONArchive__ChunkSize, &baseAllocator_);
+}
+
+void JSONArchive::AdoptFragment(std::unique_ptr<JSONArchive> fragment)
+{
+    const auto& stats = fragment->GetMemoryStats();
+    memoryStats_.allocations_ += stats.allocations_;
+    memoryStats_.allocatedBytes_ += stats.allocatedBytes_;
+    memoryStats_.currentBytes_ += stats.currentBytes_;
+    memoryStats_.peakBytes_ = std::max(memoryStats_.peakBytes_, memoryStats_.currentBytes_);
+    fragments_.push_back(std::move(fragment));
+}
+
+void JSONArchive::ReleaseFragments()
+{
+    for (const auto& fragment : fragments_)
+        memoryStats_.currentBytes_ -= fragment->GetMemoryStats().currentBytes_;
+    fragments_.clear();
+    cached_.clear();
+}
+
+void JSONArchive::DetachCached()
+{
+    if (cached_.empty())
+        return;
+
+    // Positions of spliced values are not tracked, whole document is copied
+    Value& root = root_;
+    Value copy(root, allocator_);
+    root.Swap(copy);
+    index_.clear();
+    cached_.clear();
+}
+
+// Objects with fewer members are searched linearly, lookup structures are built only for larger ones.
+static const rapidjson::SizeType JSONArchive__IndexThreshold = 16;
+
+static unsigned JSONArchive__KeyHash(const char* key, size_t length)
+{
+    unsigned hash = 0;
+    for (size_t i = 0; i < length; i++)
+        hash = detail::SDBMHash(hash, (unsigned char)key[i]);
+    return hash;
+}
+
+static bool JSONArchive__KeyEquals(const JSONArchive::Value& name, const char* key, size_t length)
+{
+    return name.GetStringLength() == length && memcmp(name.GetString(), key, length) == 0;
+}
+
+JSONArchive::ObjectIndex* JSONArchive::GetIndex(Value* object)
+{
+    // Small objects are cheaper to walk than to index
+    if (object->MemberCount() < JSONArchive__IndexThreshold)
+        return nullptr;
+
+    auto it = index_.find(object);
+    if (it == index_.end())
+        it = index_.emplace(object, ObjectIndex(&baseAllocator_)).first;
+    auto& index = it->second;
+
+    // Members were reallocated, either because object grew or because a different object now lives at this address.
+    // Rebuilding is amortized by geometric growth of member storage.
+    if (index.members_ != &*object->MemberBegin())
+    {
+        index.keys_.clear();
+        index.keyed_ = 0;
+        index.members_ = &*object->MemberBegin();
+    }
+
+    return &index;
+}
+
+int JSONArchive::FindMember(Value* object, const std::string& key)
+{
+    auto* objectIndex = GetIndex(object);
+    if (objectIndex == nullptr)
+    {
+        for (auto it = object->MemberBegin(); it != object->MemberEnd(); ++it)
+        {
+            if (JSONArchive__KeyEquals(it->name, key.c_str(), key.length()))
+                return (int)std::distance(object->MemberBegin(), it);
+        }
+        return -1;
+    }
+
+    auto& index = *objectIndex;
+    auto members = object->MemberBegin();
+    auto find = [&index, &members](unsigned hash, const char* key, size_t length) -> int {
+        auto range = index.keys_.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (JSONArchive__KeyEquals(members[it->second].name, key, length))
+                return (int)it->second;
+        }
+        return -1;
+    };
+
+    // Index names of members that were added since last lookup
+    for (; index.keyed_ < object->MemberCount(); index.keyed_++)
+    {
+        const auto& name = members[index.keyed_].name;
+
+        // First member with a given name wins, same as Value::FindMember()
+        auto hash = JSONArchive__KeyHash(name.GetString(), name.GetStringLength());
+        if (find(hash, name.GetString(), name.GetStringLength()) < 0)
+            index.keys_.emplace(hash, index.keyed_);
+    }
+
+    return find(JSONArchive__KeyHash(key.c_str(), key.length()), key.c_str(), key.length());
+}
+
+// Matches members of an object by name. Members of compared objects are usually in the same order, therefore member
+// following the previous match is tried first. Names of large objects are hashed on first miss, so that comparing two
+// objects takes linear time instead of searching one for every member of the other.
+class JSONArchive__MemberMatcher
+{
+public:
+    explicit JSONArchive__MemberMatcher(const JSONArchive::Value& object)
+        : object_(object)
+    {
+    }
+
+    const JSONArchive::Value* Find(const JSONArchive::Value& name)
+    {
+        auto members = object_.MemberBegin();
+        const rapidjson::SizeType count = object_.MemberCount();
+        if (cursor_ < count && members[cursor_].name == name)
+            return &members[cursor_++].value;
+
+        if (count < JSONArchive__IndexThreshold)
+        {
+            for (rapidjson::SizeType i = 0; i < count; i++)
+            {
+                if (members[i].name == name)
+                    return Match(i);
+            }
+            return nullptr;
+        }
+
+        if (keys_.empty())
+        {
+            // Inserted in reverse, so that first member with a given name is found first
+            keys_.reserve(count);
+            for (rapidjson::SizeType i = count; i > 0; i--)
+                keys_.emplace(JSONArchive__KeyHash(members[i - 1].name.GetString(),
+                    members[i - 1].name.GetStringLength()), i - 1);
+        }
+
+        auto range = keys_.equal_range(JSONArchive__KeyHash(name.GetString(), name.GetStringLength()));
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (members[it->second].name == name)
+                return Match(it->second);
+        }
+        return nullptr;
+    }
+
+private:
+    const JSONArchive::Value* Match(rapidjson::SizeType index)
+    {
+        cursor_ = index + 1;
+        return &object_.MemberBegin()[index].value;
+    }
+
+    const JSONArchive::Value& object_;
+    rapidjson::SizeType cursor_ = 0;
+    std::unordered_multimap<unsigned, rapidjson::SizeType> keys_;
+};
+
+// Deep comparison of values. Unlike Value::operator== it does not search one object for every member of the other.
+static bool JSONArchive__Equals(const JSONArchive::Value& a, const JSONArchive::Value& b)
+{
+    if (&a == &b)
+        return true;
+
+    if (a.IsObject() && b.IsObject())
+    {
+        if (a.MemberCount() != b.MemberCount())
+            return false;
+        JSONArchive__MemberMatcher matcher(b);
+        for (auto member = a.MemberBegin(); member != a.MemberEnd(); ++member)
+        {
+            auto* other = matcher.Find(member->name);
+            if (other == nullptr || !JSONArchive__Equals(member->value, *other))
+                return false;
+        }
+        return true;
+    }
+
+    if (a.IsArray() && b.IsArray())
+    {
+        if (a.Size() != b.Size())
+            return false;
+        for (rapidjson::SizeType i = 0; i < a.Size(); i++)
+        {
+            if (!JSONArchive__Equals(a[i], b[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // Strings sharing a buffer are not compared further
+    return a == b;
+}
+
+// Writes members of target that differ from source into patch object. Returns false if values are equal.
+static bool JSONArchive__MergeDiff(const JSONArchive::Value& source, const JSONArchive::Value& target,
+    JSONArchive::Value& patch, JSONArchive::Allocator& allocator)
+{
+    if (!source.IsObject() || !target.IsObject())
+    {
+        if (JSONArchive__Equals(source, target))
+            return false;
+        patch.CopyFrom(target, allocator);
+        return true;
+    }
+
+    patch.SetObject();
+    JSONArchive__MemberMatcher sourceMembers(source);
+    for (auto member = target.MemberBegin(); member != target.MemberEnd(); ++member)
+    {
+        JSONArchive::Value value;
+        auto* previous = sourceMembers.Find(member->name);
+        if (previous == nullptr)
+            value.CopyFrom(member->value, allocator);
+        else if (!JSONArchive__MergeDiff(*previous, member->value, value, allocator))
+            continue;
+        patch.AddMember(JSONArchive::Value(member->name, allocator), value, allocator);
+    }
+
+    // Removed members are set to null
+    JSONArchive__MemberMatcher targetMembers(target);
+    for (auto member = source.MemberBegin(); member != source.MemberEnd(); ++member)
+    {
+        if (targetMembers.Find(member->name) == nullptr)
+            patch.AddMember(JSONArchive::Value(member->name, allocator), JSONArchive::Value(), allocator);
+    }
+    return !patch.ObjectEmpty();
+}
+
+void JSONArchive::MakeMergePatch(const JSONArchive& source, JSONArchive& patch) const
+{
+    patch.Reset();
+    if (JSONArchive__MergeDiff(source.root_, root_, patch.root_, patch.allocator_))
+        return;
+
+    // Empty object leaves an object unchanged, any other value replaces the root, including an equal one
+    if (root_.IsObject())
+        patch.root_.SetObject();
+    else
+        patch.root_.CopyFrom(root_, patch.allocator_);
+}
+
+void JSONArchive::MergePatch(Value& target, const Value& patch)
+{
+    if (!patch.IsObject())
+    {
+        target.CopyFrom(patch, allocator_);
+        return;
+    }
+    if (!target.IsObject())
+        target.SetObject();
+
+    // Removed members are compacted in a single pass afterwards, so that positions found by FindMember() stay valid
+    std::vector<bool> removed;
+    std::string key;
+    for (auto member = patch.MemberBegin(); member != patch.MemberEnd(); ++member)
+    {
+        key.assign(member->name.GetString(), member->name.GetStringLength());
+        const int position = FindMember(&target, key);
+        if (member->value.IsNull())
+        {
+            if (position < 0)
+                continue;
+            removed.resize(target.MemberCount());
+            removed[position] = true;
+        }
+        else if (position >= 0)
+            MergePatch(target.MemberBegin()[position].value, member->value);
+        else
+        {
+            target.AddMember(Value(member->name, allocator_), Value(), allocator_);
+            MergePatch((target.MemberEnd() - 1)->value, member->value);
+        }
+    }
+
+    EraseMembers(target, removed);
+}
+
+void JSONArchive::EraseMembers(Value& object, const std::vector<bool>& removed)
+{
+    if (std::find(removed.begin(), removed.end(), true) == removed.end())
+        return;
+
+    auto members = object.MemberBegin();
+    rapidjson::SizeType kept = 0;
+    for (rapidjson::SizeType i = 0; i < object.MemberCount(); i++)
+    {
+        if (i < removed.size() && removed[i])
+            continue;
+        if (kept != i)
+        {
+            members[kept].name.Swap(members[i].name);
+            members[kept].value.Swap(members[i].value);
+        }
+        kept++;
+    }
+    object.EraseMember(members + kept, object.MemberEnd());
+    index_.erase(&object);
+}
+
+void JSONArchive::ApplyMergePatch(const JSONArchive& patch)
+{
+    DetachCached();
+    MergePatch(root_, patch.root_);
+}
+
+// Writes operations of JSON patch that turn source into target.
+struct JSONArchive__PatchWriter
+{
+    JSONArchive::Allocator& allocator_;
+    JSONArchive::Value& operations_;
+    std::string path_;
+
+    void Write(const char* op, const JSONArchive::Value* value)
+    {
+        JSONArchive::Value operation(rapidjson::kObjectType);
+        operation.AddMember("op", rapidjson::StringRef(op), allocator_);
+        operation.AddMember("path", JSONArchive::Value(path_.c_str(), (rapidjson::SizeType)path_.size(), allocator_),
+            allocator_);
+        if (value != nullptr)
+            operation.AddMember("value", JSONArchive::Value(*value, allocator_), allocator_);
+        operations_.PushBack(operation, allocator_);
+    }
+
+    void Diff(const JSONArchive::Value& source, const JSONArchive::Value& target)
+    {
+        const size_t length = path_.size();
+        if (&source == &target)
+            return;
+
+        if (source.IsObject() && target.IsObject())
+        {
+            JSONArchive__MemberMatcher sourceMembers(source);
+            for (auto member = target.MemberBegin(); member != target.MemberEnd(); ++member)
+            {
+                detail::AppendPathToken(path_, member->name.GetString(), member->name.GetStringLength());
+                if (auto* previous = sourceMembers.Find(member->name))
+                    Diff(*previous, member->value);
+                else
+                    Write("add", &member->value);
+                path_.resize(length);
+            }
+
+            JSONArchive__MemberMatcher targetMembers(target);
+            for (auto member = source.MemberBegin(); member != source.MemberEnd(); ++member)
+            {
+                if (targetMembers.Find(member->name) != nullptr)
+                    continue;
+                detail::AppendPathToken(path_, member->name.GetString(), member->name.GetStringLength());
+                Write("remove", nullptr);
+                path_.resize(length);
+            }
+        }
+        else if (source.IsArray() && target.IsArray())
+        {
+            // Elements past the end of source are appended, surplus elements of source are removed from the back
+            for (rapidjson::SizeType i = 0; i < target.Size(); i++)
+            {
+                const std::string index = std::to_string(i);
+                detail::AppendPathToken(path_, index.c_str(), index.size());
+                if (i < source.Size())
+                    Diff(source[i], target[i]);
+                else
+                    Write("add", &target[i]);
+                path_.resize(length);
+            }
+            for (rapidjson::SizeType i = source.Size(); i > target.Size(); i--)
+            {
+                const std::string index = std::to_string(i - 1);
+                detail::AppendPathToken(path_, index.c_str(), index.size());
+                Write("remove", nullptr);
+                path_.resize(length);
+            }
+        }
+        else if (!JSONArchive__Equals(source, target))
+            Write("replace", &target);
+    }
+};
+
+void JSONArchive::MakePatch(const JSONArchive& source, JSONArchive& patch) const
+{
+    patch.Reset();
+    patch.root_.SetArray();
+    JSONArchive__PatchWriter writer{patch.allocator_, patch.root_, {}};
+    writer.Diff(source.root_, root_);
+}
+
+// Parses array index of JSON Pointer, which may not have leading zeros.
+static bool JSONArchive__ArrayIndex(const std::string& token, rapidjson::SizeType& index)
+{
+    if (token.empty() || token.size() > 9 || (token.size() > 1 && token[0] == '0') ||
+        token.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    index = (rapidjson::SizeType)strtoul(token.c_str(), nullptr, 10);
+    return true;
+}
+
+JSONArchive::Value* JSONArchive::FindPath(const std::string& path, Value*& parent, std::string& token)
+{
+    Value* value = &root_;
+    parent = nullptr;
+    size_t position = 0;
+    while (position < path.size())
+    {
+        if (!detail::NextPathToken(path, position, token))
+            return nullptr;
+
+        parent = value;
+        value = nullptr;
+        rapidjson::SizeType index = 0;
+        if (parent->IsObject())
+        {
+            const int member = FindMember(parent, token);
+            if (member >= 0)
+                value = &parent->MemberBegin()[member].value;
+        }
+        else if (parent->IsArray() && JSONArchive__ArrayIndex(token, index) && index < parent->Size())
+            value = &(*parent)[index];
+
+        if (value == nullptr)
+        {
+            // Parent of a missing value is still of use to AddPath()
+            if (position < path.size())
+                parent = nullptr;
+            return nullptr;
+        }
+    }
+    return value;
+}
+
+bool JSONArchive::AddPath(const std::string& path, Value& value)
+{
+    Value* parent = nullptr;
+    std::string token;
+    Value* existing = FindPath(path, parent, token);
+    if (path.empty())
+    {
+        static_cast<Value&>(root_).Swap(value);
+        index_.clear();
+        return true;
+    }
+    if (parent == nullptr)
+        return false;
+
+    if (parent->IsObject())
+    {
+        if (existing != nullptr)
+            existing->Swap(value);
+        else
+            parent->AddMember(Value(token.c_str(), (rapidjson::SizeType)token.size(), allocator_), value, allocator_);
+        return true;
+    }
+
+    rapidjson::SizeType index = parent->Size();
+    if (token != "-" && (!JSONArchive__ArrayIndex(token, index) || index > parent->Size()))
+        return false;
+
+    // Inserted element is rotated into place
+    parent->PushBack(value, allocator_);
+    for (rapidjson::SizeType i = parent->Size() - 1; i > index; i--)
+        (*parent)[i].Swap((*parent)[i - 1]);
+    return true;
+}
+
+bool JSONArchive::RemovePath(const std::string& path, Value* removed)
+{
+    Value* parent = nullptr;
+    std::string token;
+    Value* value = FindPath(path, parent, token);
+    if (value == nullptr || parent == nullptr)
+        return false;
+
+    if (removed != nullptr)
+        removed->Swap(*value);
+
+    if (parent->IsObject())
+    {
+        parent->EraseMember(parent->MemberBegin() + FindMember(parent, token));
+        index_.erase(parent);
+    }
+    else
+        parent->Erase(value);
+    return true;
+}
+
+bool JSONArchive::ApplyPatch(const JSONArchive& patch)
+{
+    DetachCached();
+    index_.clear();
+    if (!patch.root_.IsArray())
+        return false;
+
+    Value* parent = nullptr;
+    std::string path;
+    std::string from;
+    std::string token;
+    for (auto* operation = patch.root_.Begin(); operation != patch.root_.End(); ++operation)
+    {
+        if (!operation->IsObject())
+            return false;
+        auto op = operation->FindMember("op");
+        auto pathMember = operation->FindMember("path");
+        if (op == operation->MemberEnd() || !op->value.IsString() || pathMember == operation->MemberEnd() ||
+            !pathMember->value.IsString())
+            return false;
+        path.assign(pathMember->value.GetString(), pathMember->value.GetStringLength());
+        const char* name = op->value.GetString();
+
+        auto fromMember = operation->FindMember("from");
+        auto valueMember = operation->FindMember("value");
+        const bool hasFrom = fromMember != operation->MemberEnd() && fromMember->value.IsString();
+        const bool hasValue = valueMember != operation->MemberEnd();
+        if (hasFrom)
+            from.assign(fromMember->value.GetString(), fromMember->value.GetStringLength());
+
+        bool succeeded = false;
+        if (strcmp(name, "add") == 0 && hasValue)
+        {
+            Value value(valueMember->value, allocator_);
+            succeeded = AddPath(path, value);
+        }
+        else if (strcmp(name, "remove") == 0)
+            succeeded = RemovePath(path, nullptr);
+        else if (strcmp(name, "replace") == 0 && hasValue)
+        {
+            auto* target = FindPath(path, parent, token);
+            if (target != nullptr)
+                target->CopyFrom(valueMember->value, allocator_);
+            succeeded = target != nullptr;
+        }
+        else if (strcmp(name, "move") == 0 && hasFrom)
+        {
+            // Value can not be moved into one of its children
+            Value value;
+            if (from == path)
+                succeeded = FindPath(path, parent, token) != nullptr;
+            else if (path.compare(0, from.size(), from) != 0 || path[from.size()] != '/')
+                succeeded = RemovePath(from, &value) && AddPath(path, value);
+        }
+        else if (strcmp(name, "copy") == 0 && hasFrom)
+        {
+            auto* source = FindPath(from, parent, token);
+            Value value;
+            if (source != nullptr)
+                value.CopyFrom(*source, allocator_);
+            succeeded = source != nullptr && AddPath(path, value);
+        }
+        else if (strcmp(name, "test") == 0 && hasValue)
+        {
+            auto* target = FindPath(path, parent, token);
+            succeeded = target != nullptr && JSONArchive__Equals(*target, valueMember->value);
+        }
+
+        if (!succeeded)
+            return false;
+    }
+    return true;
+}
+
+// Collects values of current document that differ from baseline into a delta document.
+struct JSONArchive__DeltaWriter
+{
+    JSONArchive::Allocator& allocator_;
+    JSONArchive::Value& set_;
+    JSONArchive::Value& remove_;
+    /// Path of values being compared.
+    std::string path_;
+
+    void Set(const JSONArchive::Value& value)
+    {
+        JSONArchive::Value path(path_.c_str(), (rapidjson::SizeType)path_.size(), allocator_);
+        set_.AddMember(path, JSONArchive::Value(value, allocator_), allocator_);
+    }
+
+    void Remove()
+    {
+        remove_.PushBack(JSONArchive::Value(path_.c_str(), (rapidjson::SizeType)path_.size(), allocator_), allocator_);
+    }
+
+    void Diff(const JSONArchive::Value& baseline, const JSONArchive::Value& current)
+    {
+        const size_t length = path_.size();
+        if (baseline.IsObject() && current.IsObject())
+        {
+            JSONArchive__MemberMatcher baselineMembers(baseline);
+            for (auto member = current.MemberBegin(); member != current.MemberEnd(); ++member)
+            {
+                detail::AppendPathToken(path_, member->name.GetString(), member->name.GetStringLength());
+                if (auto* previous = baselineMembers.Find(member->name))
+                    Diff(*previous, member->value);
+                else
+                    Set(member->value);
+                path_.resize(length);
+            }
+
+            JSONArchive__MemberMatcher currentMembers(current);
+            for (auto member = baseline.MemberBegin(); member != baseline.MemberEnd(); ++member)
+            {
+                if (currentMembers.Find(member->name) != nullptr)
+                    continue;
+                detail::AppendPathToken(path_, member->name.GetString(), member->name.GetStringLength());
+                Remove();
+                path_.resize(length);
+            }
+        }
+        else if (baseline.IsArray() && current.IsArray())
+        {
+            // Elements past the end of baseline are appended, surplus elements of baseline are removed from the back
+            const rapidjson::SizeType common = std::min(baseline.Size(), current.Size());
+            for (rapidjson::SizeType i = 0; i < current.Size(); i++)
+            {
+                const std::string index = std::to_string(i);
+                detail::AppendPathToken(path_, index.c_str(), index.size());
+                if (i < common)
+                    Diff(baseline[i], current[i]);
+                else
+                    Set(current[i]);
+                path_.resize(length);
+            }
+            for (rapidjson::SizeType i = baseline.Size(); i > current.Size(); i--)
+            {
+                const std::string index = std::to_string(i - 1);
+                detail::AppendPathToken(path_, index.c_str(), index.size());
+                Remove();
+                path_.resize(length);
+            }
+        }
+        else if (baseline != current)
+            Set(current);
+    }
+};
+
+void JSONArchive::MakeDelta(const JSONArchive& baseline, JSONArchive& delta) const
+{
+    delta.Reset();
+    auto& allocator = delta.allocator_;
+    delta.root_.SetObject();
+    Value set(rapidjson::kObjectType);
+    Value remove(rapidjson::kArrayType);
+    JSONArchive__DeltaWriter writer{allocator, set, remove, {}};
+    writer.Diff(baseline.root_, root_);
+
+    delta.root_.AddMember("set", set, allocator);
+    if (!remove.Empty())
+        delta.root_.AddMember("remove", remove, allocator);
+}
+
+bool JSONArchive::ApplyDelta(const JSONArchive& delta)
+{
+    DetachCached();
+    index_.clear();
+    const Value& root = delta.root_;
+    auto set = root.IsObject() ? root.FindMember("set") : root.MemberEnd();
+    if (!root.IsObject() || set == root.MemberEnd() || !set->value.IsObject())
+        return false;
+
+    std::string path;
+    std::string token;
+    for (auto member = set->value.MemberBegin(); member != set->value.MemberEnd(); ++member)
+    {
+        path.assign(member->name.GetString(), member->name.GetStringLength());
+        Value* parent = nullptr;
+        Value* target = FindPath(path, parent, token);
+        rapidjson::SizeType index = 0;
+        if (target == nullptr && parent != nullptr && parent->IsObject())
+        {
+            parent->AddMember(Value(token.c_str(), (rapidjson::SizeType)token.size(), allocator_), Value(), allocator_);
+            target = &(parent->MemberEnd() - 1)->value;
+        }
+        else if (target == nullptr && parent != nullptr && parent->IsArray() && JSONArchive__ArrayIndex(token, index) &&
+            index == parent->Size())
+        {
+            parent->PushBack(Value(), allocator_);
+            target = &(*parent)[index];
+        }
+        if (target == nullptr)
+            return false;
+        target->CopyFrom(member->value, allocator_);
+    }
+
+    auto remove = root.FindMember("remove");
+    if (remove == root.MemberEnd())
+        return true;
+    if (!remove->value.IsArray())
+        return false;
+
+    // Removals of members of the same object are consecutive. They are marked and the object is compacted once they
+    // are all found, so that positions found by FindMember() stay valid and erasing many members takes linear time.
+    Value* object = nullptr;
+    std::string objectPath;
+    std::vector<bool> removed;
+    auto compact = [&]() {
+        if (object != nullptr)
+            EraseMembers(*object, removed);
+        object = nullptr;
+    };
+
+    bool result = true;
+    for (auto* item = remove->value.Begin(); result && item != remove->value.End(); ++item)
+    {
+        if (!item->IsString())
+        {
+            result = false;
+            break;
+        }
+        path.assign(item->GetString(), item->GetStringLength());
+        const size_t slash = path.rfind('/');
+        if (slash == std::string::npos || path.compare(0, slash, objectPath) != 0 || slash != objectPath.size())
+            compact();
+
+        Value* parent = nullptr;
+        Value* value = FindPath(path, parent, token);
+        if (value == nullptr || parent == nullptr)
+            result = false;
+        else if (parent->IsObject())
+        {
+            if (parent != object)
+            {
+                compact();
+                object = parent;
+                objectPath.assign(path, 0, slash);
+                removed.assign(parent->MemberCount(), false);
+            }
+
+            // Member that was removed already is skipped, as if it was erased
+            auto members = parent->MemberBegin();
+            auto position = (rapidjson::SizeType)FindMember(parent, token);
+            while (position < removed.size() && removed[position])
+            {
+                const Value& name = members[position].name;
+                do
+                    position++;
+                while (position < removed.size() && members[position].name != name);
+            }
+            if (position < removed.size())
+                removed[position] = true;
+            else
+                result = false;
+        }
+        else
+            parent->Erase(value);
+    }
+    compact();
+    return result;
+}
+
+#if SER_PROFILE_USER_TYPES
+// Output stream that only counts characters.
+struct JSONArchive__CountingStream
+{
+    using Ch = char;
+
+    void Put(Ch /*c*/) { size_++; }
+    void Flush() { }
+
+    size_t size_ = 0;
+};
+
+size_t JSONArchive::MeasureValue(ArchiveIterator& it)
+{
+    if (!it)
+        return 0;
+
+    auto* value = static_cast<InputIterator*>(it.Get())->Current();    // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    if (value == nullptr)
+        return 0;
+
+    // Writer stack lives on the stack for values of reasonable depth
+    char buffer[1024];
+    using StackAllocator = rapidjson::MemoryPoolAllocator<rapidjson::CrtAllocator>;
+    StackAllocator allocator(buffer, sizeof(buffer));
+    JSONArchive__CountingStream stream;
+    rapidjson::Writer<JSONArchive__CountingStream, rapidjson::UTF8<>, rapidjson::UTF8<>, StackAllocator> writer(stream,
+        &allocator);
+    value->Accept(writer);
+    return stream.size_;
+}
+#endif
+
+// Name of traced span of a container: its key in parent object, or its type.
+static size_t JSONArchive__ContainerName(const JSONArchive::Value* key, Archive::ContainerType type, const char*& name)
+{
+    if (key != nullptr && key->IsString())
+    {
+        name = key->GetString();
+        return key->GetStringLength();
+    }
+
+    name = type == Archive::Array ? "array" : "map";
+    return strlen(name);
+}
+
 // ---------------------- JSONArchive::InputIterator ----------------------
 
-ArchiveIterator JSONArchive::InputIterator::Construct(rapidjson::Value* container,
-    rapidjson::Document::AllocatorType& allocator, size_t index)
+ArchiveIterator JSONArchive::InputIterator::Construct(JSONArchive::Value* container,
+    JSONArchive::Allocator& allocator, size_t index)
 {
-    return ArchiveIterator::ConstructR<InputIterator>(container, allocator, index);
+    return ArchiveIterator::ConstructR<InputIterator>(archive_, container, allocator, index);
 }
 
 void JSONArchive::InputIterator::Copy(ArchiveIterator& destination) const
@@ -39,20 +905,24 @@ void JSONArchive::InputIterator::Copy(ArchiveIterator& destination) const
     ArchiveIterator::Construct<InputIterator>(destination, *this);
 }
 
-JSONArchive::InputIterator::InputIterator(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator)
-    : container_(container)
+JSONArchive::InputIterator::InputIterator(JSONArchive* archive, JSONArchive::Value* container,
+    JSONArchive::Allocator& allocator)
+    : archive_(archive)
+    , container_(container)
     , allocator_(allocator)
 {
 }
 
-JSONArchive::InputIterator::InputIterator(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator, size_t index)
-    : container_(container)
+JSONArchive::InputIterator::InputIterator(JSONArchive* archive, JSONArchive::Value* container,
+    JSONArchive::Allocator& allocator, size_t index)
+    : archive_(archive)
+    , container_(container)
     , index_(index)
     , allocator_(allocator)
 {
 }
 
-rapidjson::Value* JSONArchive::InputIterator::Current()
+JSONArchive::Value* JSONArchive::InputIterator::Current()
 {
     if (container_ == nullptr)
         return {};
@@ -66,6 +936,14 @@ rapidjson::Value* JSONArchive::InputIterator::Current()
     return container_;
 }
 
+const JSONArchive::Value* JSONArchive::InputIterator::CurrentKey() const
+{
+    if (container_ == nullptr || !container_->IsObject() || index_ >= container_->MemberCount())
+        return nullptr;
+
+    return &(container_->MemberBegin() + index_)->name;
+}
+
 int JSONArchive::InputIterator::Size() const
 {
     if (container_ == nullptr)
@@ -85,10 +963,12 @@ ArchiveIterator JSONArchive::InputIterator::Find(const std::string& key)
     if (container_ == nullptr || !container_->IsObject())
         return {};
 
-    auto it = container_->FindMember(key.c_str());
-    if (it != container_->MemberEnd())
-        return Construct(container_, allocator_, std::distance(container_->MemberBegin(), it));
+    detail::CountMetric(detail::JSONMetrics, detail::FindCounter);
+    int index = archive_->FindMember(container_, key);
+    if (index >= 0)
+        return Construct(container_, allocator_, (size_t)index);
 
+    detail::CountMetric(detail::JSONMetrics, detail::FindMissCounter);
     return {};
 }
 
@@ -97,12 +977,12 @@ bool JSONArchive::InputIterator::AtEnd() const
     if (container_ == nullptr)
         return true;
 
-    return Size() <= index_;
+    return static_cast<size_t>(Size()) <= index_;
 }
 
 ArchiveIterator JSONArchive::InputIterator::operator[](int index)
 {
-    if (!container_ || !container_->IsArray() || index >= container_->Size())
+    if (!container_ || !container_->IsArray() || index < 0 || (rapidjson::SizeType)index >= container_->Size())
         return {};
 
     return Construct(container_, allocator_, + index);
@@ -118,10 +998,10 @@ void JSONArchive::InputIterator::operator++()
 
 // ---------------------- JSONOutputArchive::XMLOutputIterator ----------------------
 
-ArchiveIterator JSONOutputArchive::OutputIterator::Construct(rapidjson::Value* container,
-    rapidjson::Document::AllocatorType& allocator, size_t index)
+ArchiveIterator JSONOutputArchive::OutputIterator::Construct(JSONArchive::Value* container,
+    JSONArchive::Allocator& /*allocator*/, size_t index)
 {
-    return ArchiveIterator::ConstructR<OutputIterator>(container, allocator_, index);
+    return ArchiveIterator::ConstructR<OutputIterator>(archive_, container, allocator_, index);
 }
 
 void JSONOutputArchive::OutputIterator::Copy(ArchiveIterator& destination) const
@@ -129,22 +1009,24 @@ void JSONOutputArchive::OutputIterator::Copy(ArchiveIterator& destination) const
     ArchiveIterator::Construct<OutputIterator>(destination, *this);
 }
 
-JSONOutputArchive::OutputIterator::OutputIterator(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator)
-    : InputIterator(container, allocator)
+JSONOutputArchive::OutputIterator::OutputIterator(JSONArchive* archive, JSONArchive::Value* container,
+    JSONArchive::Allocator& allocator)
+    : InputIterator(archive, container, allocator)
 {
 }
 
-JSONOutputArchive::OutputIterator::OutputIterator(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator, size_t index)
-    : InputIterator(container, allocator, index)
+JSONOutputArchive::OutputIterator::OutputIterator(JSONArchive* archive, JSONArchive::Value* container,
+    JSONArchive::Allocator& allocator, size_t index)
+    : InputIterator(archive, container, allocator, index)
 {
 }
 
-rapidjson::Value* JSONOutputArchive::OutputIterator::Current()
+JSONArchive::Value* JSONOutputArchive::OutputIterator::Current()
 {
     // Automatically expanding
     if (container_ != nullptr && container_->IsArray())
     {
-        while (index_ >= Size())
+        while (index_ >= static_cast<size_t>(Size()))
             container_->PushBack({}, allocator_);
     }
 
@@ -160,8 +1042,11 @@ ArchiveIterator JSONOutputArchive::OutputIterator::operator[](int index)
     if (!container_->IsArray())
         container_->SetArray();
 
-    while (index < container_->Size())
-        container_->GetArray().PushBack(rapidjson::Value(), allocator_);
+    if (index < 0)
+        return {};
+
+    while ((rapidjson::SizeType)index >= container_->Size())
+        container_->PushBack(JSONArchive::Value(), allocator_);
 
     return Construct(container_, allocator_, index);
 }
@@ -171,13 +1056,10 @@ void JSONOutputArchive::OutputIterator::operator++()
     if (container_ == nullptr)
         return;
 
-    // Access converts container to array
+    // Access converts container to array. Elements are appended by Current() when they are accessed.
     if (!container_->IsArray())
         container_->SetArray();
 
-    while (index_ < container_->Size())
-        container_->PushBack({}, allocator_);
-
     InputIterator::operator++();
 }
 
@@ -186,16 +1068,18 @@ ArchiveIterator JSONOutputArchive::OutputIterator::Find(const std::string& key)
     if (container_ == nullptr || !container_->IsObject())
         return {};
 
-    auto it = container_->FindMember(key.c_str());
-    if (it == container_->MemberEnd())
+    detail::CountMetric(detail::JSONMetrics, detail::FindCounter);
+    int index = archive_->FindMember(container_, key);
+    if (index < 0)
     {
-        rapidjson::Value k;
-        k.SetString(key.c_str(), allocator_);
-        container_->AddMember(k, rapidjson::Value{}, allocator_);
-        it = container_->FindMember(key.c_str());
+        detail::CountMetric(detail::JSONMetrics, detail::FindMissCounter);
+        JSONArchive::Value k;
+        k.SetString(key.c_str(), (rapidjson::SizeType)key.length(), allocator_);
+        container_->AddMember(k, JSONArchive::Value{}, allocator_);
+        index = (int)container_->MemberCount() - 1;
     }
 
-    return Construct(container_, allocator_, std::distance(container_->MemberBegin(), it));
+    return Construct(container_, allocator_, (size_t)index);
 }
 
 bool JSONOutputArchive::OutputIterator::AtEnd() const
@@ -206,39 +1090,236 @@ bool JSONOutputArchive::OutputIterator::AtEnd() const
 
 // ---------------------- JSONOutputArchive ----------------------
 
-ArchiveIterator JSONOutputArchive__BeginHelper(rapidjson::Document::AllocatorType& allocator, rapidjson::Value* target, Archive::ContainerType type)
+JSONOutputArchive::JSONOutputArchive(MemoryResource* resource)
+    : JSONArchive(resource)
+{
+}
+
+JSONOutputArchive::JSONOutputArchive(void* buffer, size_t size, MemoryResource* resource)
+    : JSONArchive(buffer, size, resource)
 {
+}
+
+ArchiveIterator JSONOutputArchive__BeginHelper(JSONArchive* archive, JSONArchive::Allocator& allocator, JSONArchive::Value* target, Archive::ContainerType type)
+{
+    detail::CountMetric(detail::JSONMetrics, detail::BeginCounter);
     if (type == Archive::Array && !target->IsArray())
         target->SetArray();
     else if (type == Archive::Map && !target->IsObject())
         target->SetObject();
 
-    return ArchiveIterator::ConstructR<JSONOutputArchive::OutputIterator>(target, allocator);
+    return ArchiveIterator::ConstructR<JSONOutputArchive::OutputIterator>(archive, target, allocator);
 }
 
 ser::ArchiveIterator ser::JSONOutputArchive::Begin(ser::ArchiveIterator&& it, ser::Archive::ContainerType type)
 {
-    return JSONOutputArchive__BeginHelper(root_.GetAllocator(), static_cast<InputIterator*>(it.Get())->Current(), type);  // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto* parent = static_cast<InputIterator*>(it.Get());   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto result = JSONOutputArchive__BeginHelper(this, root_.GetAllocator(), parent->Current(), type);
+    if (Tracer::IsEnabled())
+    {
+        const char* name = nullptr;
+        size_t length = JSONArchive__ContainerName(parent->CurrentKey(), type, name);
+        TraceContainer(result, name, length);
+    }
+    return result;
 }
 
 ser::ArchiveIterator ser::JSONOutputArchive::Begin(ser::Archive::ContainerType type)
 {
-    return JSONOutputArchive__BeginHelper(root_.GetAllocator(), &root_, type);
+    auto result = JSONOutputArchive__BeginHelper(this, root_.GetAllocator(), &root_, type);
+    TraceContainer(result, "root", 4);
+    return result;
 }
 
 std::string ser::JSONOutputArchive::ToString() const
 {
+    detail::TraceScope traceScope("archive", "ToString", 8);
+    detail::Stopwatch stopwatch;
     using StringBuffer = rapidjson::GenericStringBuffer<rapidjson::UTF8<> >;
     StringBuffer buffer;
     rapidjson::PrettyWriter<StringBuffer> writer(buffer);
     writer.SetIndent(' ', 4);
     root_.Accept(writer);
-    return buffer.GetString();
+    std::string result(buffer.GetString(), buffer.GetSize());
+
+    detail::CountMetric(detail::JSONMetrics, detail::BytesOutCounter, result.size());
+    detail::RecordLatency(detail::JSONMetrics, detail::ToStringLatency, stopwatch.Elapsed());
+    return result;
+}
+
+// Writes output of rapidjson writer into a string sized up front, growing it only when output does not fit.
+class JSONOutputArchive__StringStream
+{
+public:
+    using Ch = char;
+
+    JSONOutputArchive__StringStream(std::string& string, size_t capacity)
+        : string_(string)
+    {
+        string_.resize(capacity);
+    }
+
+    void Put(Ch c)
+    {
+        if (size_ == string_.size())
+            string_.resize(size_ * 2 + 64);
+        string_[size_++] = c;
+    }
+    void Flush() { string_.resize(size_); }
+
+    /// String output is written to.
+    std::string& string_;
+    /// Number of bytes written.
+    size_t size_ = 0;
+};
+
+std::string ser::JSONOutputArchive::ToString(size_t sizeHint) const
+{
+    detail::TraceScope traceScope("archive", "ToString", 8);
+    detail::Stopwatch stopwatch;
+    std::string result;
+    JSONOutputArchive__StringStream stream(result, sizeHint);
+    rapidjson::PrettyWriter<JSONOutputArchive__StringStream> writer(stream);
+    writer.SetIndent(' ', 4);
+    root_.Accept(writer);
+    stream.Flush();
+
+    detail::CountMetric(detail::JSONMetrics, detail::BytesOutCounter, result.size());
+    detail::RecordLatency(detail::JSONMetrics, detail::ToStringLatency, stopwatch.Elapsed());
+    return result;
+}
+
+// Buffers output of rapidjson writer and hands it to a sink in blocks.
+class JSONOutputArchive__SinkStream
+{
+public:
+    using Ch = char;
+
+    explicit JSONOutputArchive__SinkStream(Sink& sink) : sink_(sink) { }
+
+    void Put(Ch c)
+    {
+        if (size_ == sizeof(buffer_))
+            Flush();
+        buffer_[size_++] = c;
+    }
+    void Flush()
+    {
+        if (size_ > 0)
+        {
+            written_ = sink_.Write(buffer_, size_) && written_;
+            total_ += size_;
+            size_ = 0;
+        }
+    }
+
+    /// Sink output is written to.
+    Sink& sink_;
+    /// Output not handed to sink yet.
+    char buffer_[16 * 1024];
+    /// Number of bytes in buffer.
+    size_t size_ = 0;
+    /// Number of bytes handed to sink.
+    size_t total_ = 0;
+    /// False if sink failed to write.
+    bool written_ = true;
+};
+
+bool JSONOutputArchive::Save(Sink& sink) const
+{
+    detail::TraceScope traceScope("archive", "Save", 4);
+    detail::Stopwatch stopwatch;
+    JSONOutputArchive__SinkStream stream(sink);
+    rapidjson::PrettyWriter<JSONOutputArchive__SinkStream> writer(stream);
+    writer.SetIndent(' ', 4);
+    root_.Accept(writer);
+    stream.Flush();
+
+    detail::CountMetric(detail::JSONMetrics, detail::BytesOutCounter, stream.total_);
+    detail::RecordLatency(detail::JSONMetrics, detail::ToStringLatency, stopwatch.Elapsed());
+    return stream.written_;
+}
+
+bool JSONOutputArchive::SerializeParallel(ArchiveIterator&& it, size_t count, ElementSerializer serializer,
+    void* context, unsigned threads)
+{
+    if (!it)
+        return false;
+
+    auto* target = static_cast<InputIterator*>(it.Get())->Current();   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto array = Begin((ArchiveIterator&&)it, Array);
+    const unsigned chunks = detail::GetParallelChunks(count, threads);
+    if (chunks < 2 || target->Size() > 0)
+        return SerializeRange(array, 0, count, serializer, context);
+
+    // Memory resources are not thread-safe, therefore fragments allocate from heap
+    std::vector<std::unique_ptr<JSONOutputArchive>> fragments(chunks);
+    std::vector<char> results(chunks);
+    detail::ParallelForChunks(count, chunks, [&](unsigned chunk, size_t begin, size_t end) {
+        fragments[chunk].reset(new JSONOutputArchive(nullptr));
+        auto fragmentArray = fragments[chunk]->Begin(Array);
+        results[chunk] = fragments[chunk]->SerializeRange(fragmentArray, begin, end, serializer, context);
+    });
+
+    // Moving a value copies its handle only, memory it points to stays in the fragment
+    bool result = true;
+    target->Reserve((rapidjson::SizeType)count, allocator_);
+    for (unsigned chunk = 0; chunk < chunks; chunk++)
+    {
+        auto& fragment = fragments[chunk];
+        for (auto* value = fragment->root_.Begin(); value != fragment->root_.End(); ++value)
+            target->PushBack(*value, allocator_);
+        result = result && results[chunk] != 0;
+        AdoptFragment(std::move(fragment));
+    }
+    return result;
+}
+
+// Copy of a value owned by SerializationCache, allocated from memory of its own.
+struct JSONOutputArchive__CachedValue : detail::CachedValue
+{
+    explicit JSONOutputArchive__CachedValue(const JSONArchive::Value& value)
+        : allocator_(1024)
+        , value_(value, allocator_)
+    {
+    }
+
+    JSONArchive::Allocator allocator_;
+    JSONArchive::Value value_;
+};
+
+bool JSONOutputArchive::SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& cache)
+{
+    if (!it)
+        return false;
+
+    auto* target = static_cast<InputIterator*>(it.Get())->Current();   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    if (target == nullptr)
+        return false;
+
+    const unsigned format = detail::type_id<JSONOutputArchive>();
+    if (auto cached = cache.Get(format))
+    {
+        // Copying a handle does not copy memory it points to, allocators of document and cache never free values
+        detail::CountMetric(detail::JSONMetrics, detail::CacheHitCounter);
+        const auto& source = static_cast<const JSONOutputArchive__CachedValue&>(*cached).value_;
+        memcpy(static_cast<void*>(target), &source, sizeof(Value));
+        cached_.push_back(std::move(cached));
+        return true;
+    }
+
+    // Serializer writes to subtree of target only, therefore target stays in place
+    detail::CountMetric(detail::JSONMetrics, detail::CacheMissCounter);
+    if (!Serialize((ArchiveIterator&&)it, typeId, value))
+        return false;
+    cache.Set(format, std::make_shared<JSONOutputArchive__CachedValue>(*target));
+    return true;
 }
 
 template<typename T>
-bool JSONOutputArchive__SerializeValueHelper(rapidjson::Document::AllocatorType& allocator, ArchiveIterator& it, T value)
+bool JSONOutputArchive__SerializeValueHelper(JSONArchive::Allocator& allocator, ArchiveIterator& it, T value)
 {
+    detail::CountMetric(detail::JSONMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
@@ -307,6 +1388,7 @@ bool JSONOutputArchive::Serialize(ArchiveIterator&& it, double& value)
 
 bool JSONOutputArchive::Serialize(ArchiveIterator&& it, std::string& value)
 {
+    detail::CountMetric(detail::JSONMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
@@ -320,33 +1402,460 @@ bool JSONOutputArchive::Serialize(ArchiveIterator&& it, std::string& value)
 
 // ---------------------- JSONInputArchive ----------------------
 
-JSONInputArchive::JSONInputArchive(const std::string& json_data)
+JSONInputArchive::JSONInputArchive(MemoryResource* resource)
+    : JSONArchive(resource)
 {
-    root_.Parse(json_data.c_str());
 }
 
-static ArchiveIterator JSONInputArchive__BeginHelper(rapidjson::Document::AllocatorType& allocator, rapidjson::Value* target, Archive::ContainerType type)
+JSONInputArchive::JSONInputArchive(void* buffer, size_t size, MemoryResource* resource)
+    : JSONArchive(buffer, size, resource)
 {
+}
+
+JSONInputArchive::JSONInputArchive(const std::string& json_data, MemoryResource* resource)
+    : JSONArchive(resource)
+{
+    Load(json_data);
+}
+
+// Smallest amount of json worth scanning and parsing on a separate thread.
+static const size_t JSONInputArchive__MinChunkBytes = 256 * 1024;
+static const size_t JSONInputArchive__NoPosition = (size_t)-1;
+
+static bool JSONInputArchive__IsSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Structure of a chunk of json, scanned without knowing whether chunk starts inside a string or at which depth. Level i
+// is depth i levels above depth at beginning of chunk.
+struct JSONInputArchive__ChunkScan
+{
+    /// True if chunk ends inside a string.
+    bool endsInString_ = false;
+    /// Depth at end of chunk relative to depth at beginning of chunk.
+    int depth_ = 0;
+    /// Position of first comma at each level chunk reaches.
+    std::vector<size_t> commas_;
+    /// Position of bracket that closes each level chunk reaches, except level 0.
+    std::vector<size_t> closes_;
+};
+
+static void JSONInputArchive__ScanChunk(const char* data, size_t begin, size_t end, bool inString,
+    JSONInputArchive__ChunkScan& scan)
+{
+    int depth = 0;
+    scan.commas_.assign(1, JSONInputArchive__NoPosition);
+    scan.closes_.assign(1, JSONInputArchive__NoPosition);
+    for (size_t i = begin; i < end; i++)
+    {
+        const char c = data[i];
+        if (inString)
+        {
+            // Chunks never end with a backslash, skipped character is always inside the chunk
+            if (c == '\\')
+                i++;
+            else if (c == '"')
+                inString = false;
+            continue;
+        }
+
+        switch (c)
+        {
+        case '"':
+            inString = true;
+            break;
+        case '[':
+        case '{':
+            depth++;
+            break;
+        case ']':
+        case '}':
+            if (--depth < 0 && (size_t)-depth == scan.closes_.size())
+            {
+                scan.closes_.push_back(i);
+                scan.commas_.push_back(JSONInputArchive__NoPosition);
+            }
+            break;
+        case ',':
+            if (depth <= 0 && scan.commas_[-depth] == JSONInputArchive__NoPosition)
+                scan.commas_[-depth] = i;
+            break;
+        default:
+            break;
+        }
+    }
+    scan.endsInString_ = inString;
+    scan.depth_ = depth;
+}
+
+// Reads a slice of json enclosed in a pair of brackets, which turns a list of elements or members into a document.
+class JSONInputArchive__SliceStream
+{
+public:
+    using Ch = char;
+
+    JSONInputArchive__SliceStream(char open, const char* begin, const char* end, char close)
+        : open_(open), begin_(begin), current_(begin), end_(end), close_(close)
+    {
+    }
+
+    Ch Peek() const { return open_ != 0 ? open_ : (current_ != end_ ? *current_ : close_); }
+    Ch Take()
+    {
+        const Ch c = Peek();
+        if (open_ != 0)
+            open_ = 0;
+        else if (current_ != end_)
+            current_++;
+        else
+            close_ = 0;
+        return c;
+    }
+    size_t Tell() const { return (size_t)(current_ - begin_); }
+
+    Ch* PutBegin() { RAPIDJSON_ASSERT(false); return nullptr; }
+    void Put(Ch) { RAPIDJSON_ASSERT(false); }
+    void Flush() { RAPIDJSON_ASSERT(false); }
+    size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+
+private:
+    Ch open_;
+    const Ch* begin_;
+    const Ch* current_;
+    const Ch* end_;
+    Ch close_;
+};
+
+bool JSONInputArchive::ParseParallel(const char* data, size_t size)
+{
+    const unsigned chunks = detail::GetParallelChunks(size, threads_, JSONInputArchive__MinChunkBytes);
+    if (chunks < 2)
+        return false;
+
+    size_t open = 0;
+    while (open < size && JSONInputArchive__IsSpace(data[open]))
+        open++;
+    if (open == size || (data[open] != '[' && data[open] != '{'))
+        return false;
+    const char openBracket = data[open];
+    const char closeBracket = openBracket == '[' ? ']' : '}';
+
+    // First character of a chunk is never escaped, because it does not follow a backslash
+    std::vector<size_t> bounds(chunks + 1, size);
+    bounds[0] = open + 1;
+    for (unsigned chunk = 1; chunk < chunks; chunk++)
+    {
+        size_t bound = std::max(bounds[chunk - 1], size * chunk / chunks);
+        while (bound < size && data[bound - 1] == '\\')
+            bound++;
+        bounds[chunk] = bound;
+    }
+
+    // Whether a chunk starts inside a string is known only after previous chunks are scanned, therefore both
+    // possibilities are scanned speculatively
+    std::vector<JSONInputArchive__ChunkScan> scans(chunks * 2);
+    detail::ParallelFor(chunks, [&](unsigned chunk) {
+        JSONInputArchive__ScanChunk(data, bounds[chunk], bounds[chunk + 1], false, scans[chunk * 2]);
+        if (chunk > 0)
+            JSONInputArchive__ScanChunk(data, bounds[chunk], bounds[chunk + 1], true, scans[chunk * 2 + 1]);
+    });
+
+    // Follow actual state through chunks and split root container at first comma between its elements in each chunk
+    std::vector<size_t> splits;
+    size_t close = JSONInputArchive__NoPosition;
+    bool inString = false;
+    size_t depth = 1;
+    for (unsigned chunk = 0; chunk < chunks && close == JSONInputArchive__NoPosition; chunk++)
+    {
+        const auto& scan = scans[chunk * 2 + (inString ? 1 : 0)];
+        if (depth < scan.closes_.size())
+            close = scan.closes_[depth];
+
+        const size_t comma = depth - 1 < scan.commas_.size() ? scan.commas_[depth - 1] : JSONInputArchive__NoPosition;
+        if (chunk > 0 && comma < close)
+            splits.push_back(comma);
+
+        depth += scan.depth_;
+        inString = scan.endsInString_;
+    }
+
+    if (close == JSONInputArchive__NoPosition || splits.empty())
+        return false;
+    for (size_t i = close + 1; i < size; i++)
+    {
+        if (!JSONInputArchive__IsSpace(data[i]))
+            return false;
+    }
+
+    // A wrong split makes some slice malformed, slices that all parse are the elements of the document
+    const unsigned slices = (unsigned)splits.size() + 1;
+    std::vector<std::unique_ptr<JSONInputArchive>> fragments(slices);
+    std::vector<char> results(slices);
+    detail::ParallelFor(slices, [&](unsigned slice) {
+        const size_t begin = slice == 0 ? open + 1 : splits[slice - 1] + 1;
+        const size_t end = slice + 1 < slices ? splits[slice] : close;
+        JSONInputArchive__SliceStream stream(openBracket, data + begin, data + end, closeBracket);
+        fragments[slice].reset(new JSONInputArchive(nullptr));
+        auto& document = fragments[slice]->root_;
+        document.ParseStream(stream);
+        results[slice] = !document.HasParseError() &&
+            (document.IsArray() ? !document.Empty() : !document.ObjectEmpty());
+    });
+
+    for (auto result : results)
+    {
+        if (result == 0)
+            return false;
+    }
+
+    // Moving a value copies its handle only, memory it points to stays in the fragment
+    if (openBracket == '[')
+    {
+        rapidjson::SizeType count = 0;
+        for (const auto& fragment : fragments)
+            count += fragment->root_.Size();
+
+        root_.SetArray();
+        root_.Reserve(count, allocator_);
+        for (const auto& fragment : fragments)
+        {
+            for (auto* value = fragment->root_.Begin(); value != fragment->root_.End(); ++value)
+                root_.PushBack(*value, allocator_);
+        }
+    }
+    else
+    {
+        root_.SetObject();
+        for (const auto& fragment : fragments)
+        {
+            for (auto member = fragment->root_.MemberBegin(); member != fragment->root_.MemberEnd(); ++member)
+                root_.AddMember(member->name, member->value, allocator_);
+        }
+    }
+
+    for (auto& fragment : fragments)
+        AdoptFragment(std::move(fragment));
+    return true;
+}
+
+bool JSONInputArchive::Load(const std::string& json_data)
+{
+    return Parse(json_data.c_str(), json_data.size(), true);
+}
+
+bool JSONInputArchive::Load(const char* data, size_t size)
+{
+    return Parse(data, size, false);
+}
+
+bool JSONInputArchive::Parse(const char* data, size_t size, bool terminated)
+{
+    detail::TraceScope traceScope("archive", "Parse", 5);
+    detail::Stopwatch stopwatch;
+    index_.clear();
+    root_.SetNull();
+    ReleaseFragments();
+    feed_ = FeedState();
+
+    // Documents that can not be split, or were split wrongly, are parsed on a single thread
+    bool result = threads_ != 1 && ParseParallel(data, size);
+    if (!result && terminated)
+        result = !root_.Parse(data).HasParseError();
+    else if (!result)
+    {
+        rapidjson::MemoryStream stream(data, size);
+        result = !root_.ParseStream(stream).HasParseError();
+    }
+
+    detail::CountMetric(detail::JSONMetrics, detail::BytesInCounter, size);
+    detail::RecordLatency(detail::JSONMetrics, detail::ParseLatency, stopwatch.Elapsed());
+    return result;
+}
+
+void JSONInputArchive::Reset(size_t highWaterMark)
+{
+    feed_ = FeedState();
+    JSONArchive::Reset(highWaterMark);
+}
+
+bool JSONInputArchive::Feed(const char* data, size_t size)
+{
+    detail::TraceScope traceScope("archive", "Feed", 4);
+    detail::CountMetric(detail::JSONMetrics, detail::BytesInCounter, size);
+    auto& feed = feed_;
+    if (feed.stage_ == FeedIdle)
+    {
+        index_.clear();
+        root_.SetNull();
+        ReleaseFragments();
+        feed.stage_ = FeedRoot;
+    }
+    else if (feed.stage_ == FeedScalar)
+    {
+        feed.pending_.append(data, size);
+        return true;
+    }
+
+    // Element of root container starts in buffered input, or in this piece after a separator
+    size_t start = 0;
+    for (size_t i = 0; i < size && feed.stage_ != FeedFailed; i++)
+    {
+        const char c = data[i];
+        switch (feed.stage_)
+        {
+        case FeedRoot:
+            if (JSONInputArchive__IsSpace(c))
+                break;
+            if (c == '[' || c == '{')
+            {
+                feed.open_ = c;
+                feed.depth_ = 1;
+                feed.stage_ = FeedContainer;
+                if (c == '[')
+                    root_.SetArray();
+                else
+                    root_.SetObject();
+                start = i + 1;
+                break;
+            }
+            // End of a scalar is not known until input ends
+            feed.stage_ = FeedScalar;
+            feed.pending_.append(data + i, size - i);
+            return true;
+        case FeedContainer:
+            if (feed.inString_)
+            {
+                if (feed.escaped_)
+                    feed.escaped_ = false;
+                else if (c == '\\')
+                    feed.escaped_ = true;
+                else if (c == '"')
+                    feed.inString_ = false;
+                break;
+            }
+            if (c == '"')
+                feed.inString_ = true;
+            else if (c == '[' || c == '{')
+                feed.depth_++;
+            else if (c == ']' || c == '}')
+            {
+                if (--feed.depth_ > 0)
+                    break;
+                const bool matches = (c == ']') == (feed.open_ == '[');
+                feed.stage_ = matches && FeedElement(data + start, data + i, true) ? FeedClosed : FeedFailed;
+            }
+            else if (c == ',' && feed.depth_ == 1)
+            {
+                if (!FeedElement(data + start, data + i, false))
+                    feed.stage_ = FeedFailed;
+                start = i + 1;
+            }
+            break;
+        case FeedClosed:
+            if (!JSONInputArchive__IsSpace(c))
+                feed.stage_ = FeedFailed;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (feed.stage_ == FeedContainer)
+        feed.pending_.append(data + start, size - start);
+    return feed.stage_ != FeedFailed;
+}
+
+bool JSONInputArchive::FeedElement(const char* begin, const char* end, bool last)
+{
+    auto& pending = feed_.pending_;
+    if (!pending.empty())
+    {
+        pending.append(begin, end);
+        begin = pending.data();
+        end = begin + pending.size();
+    }
+
+    const char* first = begin;
+    while (first < end && JSONInputArchive__IsSpace(*first))
+        first++;
+
+    bool result = false;
+    if (first == end)
+        result = last && (root_.IsArray() ? root_.Empty() : root_.ObjectEmpty());
+    else
+    {
+        // Element is parsed as the only element of a container, which gives members their key
+        const char close = feed_.open_ == '[' ? ']' : '}';
+        JSONInputArchive__SliceStream stream(feed_.open_, first, end, close);
+        Document piece(&allocator_, 1024, &baseAllocator_);
+        piece.ParseStream(stream);
+        if (piece.HasParseError())
+            result = false;
+        else if (piece.IsArray() && piece.Size() == 1)
+        {
+            root_.PushBack(piece[0], allocator_);
+            result = true;
+        }
+        else if (piece.IsObject() && piece.MemberCount() == 1)
+        {
+            root_.AddMember(piece.MemberBegin()->name, piece.MemberBegin()->value, allocator_);
+            result = true;
+        }
+    }
+
+    pending.clear();
+    return result;
+}
+
+bool JSONInputArchive::EndFeed()
+{
+    auto& feed = feed_;
+    bool result = feed.stage_ == FeedClosed;
+    if (feed.stage_ == FeedScalar)
+    {
+        rapidjson::MemoryStream stream(feed.pending_.data(), feed.pending_.size());
+        result = !root_.ParseStream(stream).HasParseError();
+    }
+
+    feed = FeedState();
+    return result;
+}
+
+static ArchiveIterator JSONInputArchive__BeginHelper(JSONArchive* archive, JSONArchive::Allocator& allocator, JSONArchive::Value* target, Archive::ContainerType type)
+{
+    detail::CountMetric(detail::JSONMetrics, detail::BeginCounter);
     if (type == Archive::Array && !target->IsArray())
         return {};
     else if (type == Archive::Map && !target->IsObject())
         return {};
 
-    return ArchiveIterator::ConstructR<JSONArchive::InputIterator>(target, allocator);
+    return ArchiveIterator::ConstructR<JSONArchive::InputIterator>(archive, target, allocator);
 }
 
 ArchiveIterator JSONInputArchive::Begin(ArchiveIterator&& it, Archive::ContainerType type)
 {
-    return JSONInputArchive__BeginHelper(root_.GetAllocator(), static_cast<InputIterator*>(it.Get())->Current(), type);   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto* parent = static_cast<InputIterator*>(it.Get());   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto result = JSONInputArchive__BeginHelper(this, root_.GetAllocator(), parent->Current(), type);
+    if (Tracer::IsEnabled())
+    {
+        const char* name = nullptr;
+        size_t length = JSONArchive__ContainerName(parent->CurrentKey(), type, name);
+        TraceContainer(result, name, length);
+    }
+    return result;
 }
 
 ArchiveIterator JSONInputArchive::Begin(Archive::ContainerType type)
 {
-    return JSONInputArchive__BeginHelper(root_.GetAllocator(), &root_, type);
+    auto result = JSONInputArchive__BeginHelper(this, root_.GetAllocator(), &root_, type);
+    TraceContainer(result, "root", 4);
+    return result;
 }
 
 bool JSONInputArchive::Serialize(ArchiveIterator&& it, bool& value)
 {
+    detail::CountMetric(detail::JSONMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
@@ -363,6 +1872,7 @@ bool JSONInputArchive::Serialize(ArchiveIterator&& it, bool& value)
 
 bool JSONInputArchive::Serialize(ArchiveIterator&& it, std::string& value)
 {
+    detail::CountMetric(detail::JSONMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
@@ -381,6 +1891,7 @@ template<typename T>
 static typename std::enable_if<std::is_floating_point<T>::value, bool>::type
 JSONInputArchive__SerializeValueHelper(ArchiveIterator& it, T& value)
 {
+    detail::CountMetric(detail::JSONMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
@@ -404,6 +1915,7 @@ template<typename T>
 static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, bool>::type
 JSONInputArchive__SerializeValueHelper(ArchiveIterator& it, T& value)
 {
+    detail::CountMetric(detail::JSONMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
@@ -427,6 +1939,7 @@ template<typename T>
 static typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, bool>::type
 JSONInputArchive__SerializeValueHelper(ArchiveIterator& it, T& value)
 {
+    detail::CountMetric(detail::JSONMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
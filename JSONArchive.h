@@ -21,9 +21,15 @@
 //
 #pragma once
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "rapidjson/document.h"
 
 #include "Archive.h"
+#include "Memory.h"
+#include "Sink.h"
 
 namespace ser
 {
@@ -31,23 +37,33 @@ namespace ser
 class JSONArchive : public Archive
 {
 public:
+    /// Allocator of document values.
+    using Allocator = rapidjson::MemoryPoolAllocator<detail::ResourceAllocator>;
+    /// Type of document values.
+    using Value = rapidjson::GenericValue<rapidjson::UTF8<>, Allocator>;
+    /// Type of document.
+    using Document = rapidjson::GenericDocument<rapidjson::UTF8<>, Allocator, detail::ResourceAllocator>;
+
     /// Implements a validating iterator for reading.
     class InputIterator : public detail::IArchiveIterator
     {
     protected:
-        rapidjson::Value* container_ = nullptr;
+        JSONArchive* archive_ = nullptr;
+        Value* container_ = nullptr;
         size_t index_ = 0;
-        rapidjson::Document::AllocatorType& allocator_;
+        Allocator& allocator_;
 
-        virtual ArchiveIterator Construct(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator, size_t index);
+        virtual ArchiveIterator Construct(Value* container, Allocator& allocator, size_t index);
         void Copy(ArchiveIterator& destination) const override;
 
     public:
-        explicit InputIterator(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator);
-        explicit InputIterator(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator, size_t index);
+        explicit InputIterator(JSONArchive* archive, Value* container, Allocator& allocator);
+        explicit InputIterator(JSONArchive* archive, Value* container, Allocator& allocator, size_t index);
         InputIterator(const InputIterator& other) = default;
 
-        virtual rapidjson::Value* Current();
+        virtual Value* Current();
+        /// Returns name of current member if iterating an object, otherwise null.
+        const Value* CurrentKey() const;
         int Size() const override;
         ArchiveIterator Find(const std::string& key) override;
         bool AtEnd() const override;
@@ -58,7 +74,111 @@ public:
         void operator++() override;
     };
 
-    rapidjson::Document root_;
+    /// Clear document. Memory chunks of document allocator are merged into a single buffer which is reused as first
+    /// chunk of allocator, therefore documents of similar size do not allocate any memory after a reset. Fragments
+    /// are released.
+    void Reset(size_t highWaterMark = 0) override;
+    /// Write values of this document that differ from specified baseline into document of delta archive, replacing it.
+    /// Delta is an object whose "set" member maps paths (JSON Pointer, RFC 6901) to new values and whose "remove"
+    /// member lists paths of removed values, if any. Objects and arrays are compared member by member, other values as
+    /// a whole.
+    void MakeDelta(const JSONArchive& baseline, JSONArchive& delta) const;
+    /// Apply delta made by MakeDelta() to this document, which must be the baseline delta was made against. Document
+    /// becomes equal to the document delta was made from. Returns false if delta is malformed or does not match this
+    /// document, which may be partially modified then.
+    bool ApplyDelta(const JSONArchive& delta);
+    /// Write RFC 7386 merge patch which turns specified source document into this document into document of patch
+    /// archive, replacing it. Merge patch can not tell null members of this document apart from removed members,
+    /// applying the patch removes them.
+    void MakeMergePatch(const JSONArchive& source, JSONArchive& patch) const;
+    /// Apply RFC 7386 merge patch to this document in place.
+    void ApplyMergePatch(const JSONArchive& patch);
+    /// Write RFC 6902 JSON patch which turns specified source document into this document into document of patch
+    /// archive, replacing it. Patch consists of "add", "remove" and "replace" operations.
+    void MakePatch(const JSONArchive& source, JSONArchive& patch) const;
+    /// Apply RFC 6902 JSON patch to this document in place. All operations are supported. Returns false if patch is
+    /// malformed or any operation fails, operations preceding the failed one stay applied.
+    bool ApplyPatch(const JSONArchive& patch);
+
+    /// Lookup structures of a single object.
+    struct ObjectIndex
+    {
+        /// Construct empty index which allocates through specified allocator of archive.
+        explicit ObjectIndex(const detail::ResourceAllocator* allocator)
+            : keys_(detail::ArchiveAllocator<std::pair<const unsigned, rapidjson::SizeType>>(allocator))
+        {
+        }
+
+        /// Members of object when index was last updated. Object reallocates its members when it grows.
+        const Value::Member* members_ = nullptr;
+        /// Positions of members, mapped by hash of their name.
+        std::unordered_multimap<unsigned, rapidjson::SizeType, std::hash<unsigned>, std::equal_to<unsigned>,
+            detail::ArchiveAllocator<std::pair<const unsigned, rapidjson::SizeType>>> keys_;
+        /// Number of members that were already inserted into keys_.
+        rapidjson::SizeType keyed_ = 0;
+    };
+
+    /// Returns lookup structures of specified object or null if object is small enough to be searched linearly.
+    /// Lookup structures are built on first access and extended when new members are added to the object, therefore
+    /// key lookup takes constant time.
+    ObjectIndex* GetIndex(Value* object);
+    /// Returns position of first member of specified object with specified name or -1.
+    int FindMember(Value* object, const std::string& key);
+#if SER_PROFILE_USER_TYPES
+    size_t MeasureValue(ArchiveIterator& it) override;
+#endif
+
+protected:
+    /// Construct archive which allocates document memory from specified resource, or heap if it is null.
+    explicit JSONArchive(MemoryResource* resource);
+    /// Construct archive which uses specified buffer as first chunk of document memory. Remaining memory is allocated
+    /// from specified resource, or heap if it is null.
+    JSONArchive(void* buffer, size_t size, MemoryResource* resource);
+
+    /// Allocator of document memory chunks and parser stack.
+    detail::ResourceAllocator baseAllocator_;
+    /// User-supplied buffer used as first chunk of allocator_.
+    void* initialBuffer_ = nullptr;
+    /// Size of initialBuffer_ in bytes.
+    size_t initialBufferSize_ = 0;
+    /// Memory retained between resets, used as first chunk of allocator_ when it is larger than initialBuffer_.
+    std::unique_ptr<char, detail::BlockDeleter> buffer_;
+    /// Size of buffer_ in bytes.
+    size_t bufferSize_ = 0;
+    /// Allocator of document values.
+    Allocator allocator_;
+    /// Cached lookup structures of objects, allocated from resource of archive.
+    std::unordered_map<const Value*, ObjectIndex, std::hash<const Value*>, std::equal_to<const Value*>,
+        detail::ArchiveAllocator<std::pair<const Value* const, ObjectIndex>>> index_;
+    /// Archives whose documents own memory of values that were moved into this document, because they were produced
+    /// on other threads.
+    std::vector<std::unique_ptr<JSONArchive>> fragments_;
+    /// Cache entries whose values were spliced into this document.
+    std::vector<std::shared_ptr<const detail::CachedValue>> cached_;
+
+    /// Keep specified archive alive until this document is cleared and account its memory in stats of this archive.
+    void AdoptFragment(std::unique_ptr<JSONArchive> fragment);
+    /// Release fragments and cache entries. Document must not reference their values anymore.
+    void ReleaseFragments();
+    /// Copy document into memory of its own and release cache entries, so that values spliced from the cache are not
+    /// modified with the document. Called before the document is modified in place.
+    void DetachCached();
+
+    /// Returns value at specified path (JSON Pointer) of this document or null. Container of the value and last token
+    /// of path are returned in parent and token, parent is null for root path. Objects are searched by FindMember().
+    Value* FindPath(const std::string& path, Value*& parent, std::string& token);
+    /// Add specified value at specified path, replacing member of an object with the same name or inserting into an
+    /// array. Token "-" appends to an array. Returns false if parent of value does not exist.
+    bool AddPath(const std::string& path, Value& value);
+    /// Remove value at specified path and move it into removed unless it is null. Returns false if there is no value.
+    bool RemovePath(const std::string& path, Value* removed);
+    /// Merge specified RFC 7386 merge patch into specified value of this document.
+    void MergePatch(Value& target, const Value& patch);
+    /// Erase members of specified object whose positions are marked in removed, keeping order of remaining members.
+    void EraseMembers(Value& object, const std::vector<bool>& removed);
+
+public:
+    Document root_;
 };
 
 class JSONOutputArchive : public JSONArchive
@@ -69,13 +189,13 @@ public:
     class OutputIterator : public InputIterator
     {
     protected:
-        ArchiveIterator Construct(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator, size_t index) override;
+        ArchiveIterator Construct(Value* container, Allocator& allocator, size_t index) override;
         void Copy(ArchiveIterator& destination) const override;
     public:
-        explicit OutputIterator(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator);
-        explicit OutputIterator(rapidjson::Value* container, rapidjson::Document::AllocatorType& allocator, size_t index);
+        explicit OutputIterator(JSONArchive* archive, Value* container, Allocator& allocator);
+        explicit OutputIterator(JSONArchive* archive, Value* container, Allocator& allocator, size_t index);
 
-        rapidjson::Value* Current() override;
+        Value* Current() override;
         ArchiveIterator operator[](int index) override;
         void operator++() override;
         ArchiveIterator Find(const std::string& key) override;
@@ -88,14 +208,36 @@ private:
     SER_USER_CONTAINER(JSONOutputArchive);
 public:
 
-    JSONOutputArchive() = default;
+    /// Construct archive which allocates memory from specified resource, or heap if it is null.
+    explicit JSONOutputArchive(MemoryResource* resource = MemoryResourceScope::Current());
+    /// Construct archive which allocates memory from specified buffer first, then from specified resource.
+    JSONOutputArchive(void* buffer, size_t size, MemoryResource* resource = MemoryResourceScope::Current());
 
     /// Begin writing to container of specified type. Container pointed by specified iterator will be converted to specified type.
     ArchiveIterator Begin(ArchiveIterator&& it, ContainerType type) override;
     /// Begin writing to container of specified type. Root container will be converted to specified type.
     ArchiveIterator Begin(ContainerType type) override;
-    /// Return serialized JSON result.
-    std::string ToString() const;
+    /// Return serialized JSON result. Archives of other JSON-based formats override it, as well as the other
+    /// ToString() and Save(), therefore output is in their format even through a reference to JSONOutputArchive.
+    virtual std::string ToString() const;
+    /// Return serialized JSON result, formatted straight into a string that reserves specified number of bytes up
+    /// front. Pass size counted by SizeArchive, so that output is allocated once and not copied.
+    virtual std::string ToString(size_t sizeHint) const;
+    /// Write serialized JSON to specified sink as it is formatted, without building a string. Output is the same as
+    /// ToString(). Returns false if sink failed to write.
+    virtual bool Save(Sink& sink) const;
+
+    using Archive::SerializeParallel;
+    /// Serialize chunks of array into documents of their own on multiple threads. Their values are moved into the
+    /// array without copying, documents are kept alive until Reset().
+    bool SerializeParallel(ArchiveIterator&& it, size_t count, ElementSerializer serializer, void* context,
+        unsigned threads = 0) override;
+    using Archive::SerializeCached;
+    /// Serialize user type through specified cache, which stores a copy of its value. Cached value is spliced into the
+    /// document by copying its handle only and cache entry is kept alive until Reset(). Spliced values share memory
+    /// with the cache, therefore they must not be serialized into again. ApplyDelta(), ApplyPatch() and
+    /// ApplyMergePatch() copy the document before modifying it.
+    bool SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& cache) override;
 
     bool Serialize(ArchiveIterator&& it, bool& value) override;
     bool Serialize(ArchiveIterator&& it, int8_t& value) override;
@@ -118,8 +260,35 @@ public:
 private:
     SER_USER_CONTAINER(JSONInputArchive);
 public:
+    /// Construct empty input archive which allocates memory from specified resource, or heap if it is null. Use Load()
+    /// to read json.
+    explicit JSONInputArchive(MemoryResource* resource = MemoryResourceScope::Current());
+    /// Construct empty input archive which allocates memory from specified buffer first, then from specified resource.
+    JSONInputArchive(void* buffer, size_t size, MemoryResource* resource = MemoryResourceScope::Current());
     /// Construct input archive that will read specified json.
-    explicit JSONInputArchive(const std::string& json_data);
+    explicit JSONInputArchive(const std::string& json_data, MemoryResource* resource = MemoryResourceScope::Current());
+    /// Parse specified json into the document. Returns false if json is malformed. Call Reset() before loading another
+    /// document into the same archive in order to reuse memory of previous document.
+    bool Load(const std::string& json_data);
+    /// Parse json in specified memory range into the document. Memory is only read during the call and does not need to
+    /// be null-terminated, which allows loading documents straight from mapped files.
+    bool Load(const char* data, size_t size);
+    /// Set number of threads documents are parsed on, 0 for all hardware threads. Elements of large root arrays and
+    /// members of large root objects are then located by a parallel scan and parsed concurrently. Documents that can not
+    /// be split are parsed on a single thread. Default is 1.
+    void SetThreads(unsigned threads) { threads_ = threads; }
+    /// Parse next piece of a document that arrives in pieces, for example from a socket. First call after construction,
+    /// Load(), Reset() or EndFeed() starts a new document. Elements of root array and members of root object are added
+    /// to the document as soon as they are complete, only the incomplete one is buffered. Iterators into the document
+    /// may be invalidated by the call. Returns false once input is malformed.
+    bool Feed(const char* data, size_t size);
+    /// Finish document fed by Feed(). Scalar root value is parsed now. Returns false if document is incomplete or
+    /// malformed, elements received so far are kept.
+    bool EndFeed();
+    /// Returns true if root container of document fed by Feed() was closed.
+    bool IsFeedComplete() const { return feed_.stage_ == FeedClosed; }
+    /// Clear document and stop feeding it.
+    void Reset(size_t highWaterMark = 0) override;
     /// Begin iterating container of specified type at specified iterator.
     ArchiveIterator Begin(ArchiveIterator&& it, ContainerType type) override;
     /// Begin iterating container of specified type at archive root.
@@ -137,6 +306,57 @@ public:
     bool Serialize(ArchiveIterator&& it, float& value) override;
     bool Serialize(ArchiveIterator&& it, double& value) override;
     bool Serialize(ArchiveIterator&& it, std::string& value) override;
+
+protected:
+    /// Parse json in specified memory range into the document, in parallel if enabled. Null-terminated json is parsed
+    /// without checking for end of range. Both Load() overloads parse through it, archives of other JSON-based formats
+    /// override it.
+    virtual bool Parse(const char* data, size_t size, bool terminated);
+    /// Split root container of specified json into slices on multiple threads, parse them concurrently and stitch them
+    /// into the document. Returns false if json could not be split or any slice is malformed, document is null then.
+    bool ParseParallel(const char* data, size_t size);
+    /// Parse element or member of root container fed by Feed(), consisting of buffered input followed by specified
+    /// range, and append it to root container. Empty range closing an empty container is accepted.
+    bool FeedElement(const char* begin, const char* end, bool last);
+
+    /// Progress of document fed by Feed().
+    enum FeedStage
+    {
+        /// No document is being fed.
+        FeedIdle,
+        /// Waiting for root value.
+        FeedRoot,
+        /// Inside root array or object.
+        FeedContainer,
+        /// Root value is a scalar, it is buffered until EndFeed().
+        FeedScalar,
+        /// Root container was closed.
+        FeedClosed,
+        /// Input was malformed.
+        FeedFailed,
+    };
+
+    /// State of document fed by Feed(), kept between calls.
+    struct FeedState
+    {
+        /// Progress of document.
+        FeedStage stage_ = FeedIdle;
+        /// Opening bracket of root container.
+        char open_ = 0;
+        /// Depth of brackets, root container is at depth 1.
+        int depth_ = 0;
+        /// True if input ended inside a string.
+        bool inString_ = false;
+        /// True if input ended after a backslash inside a string.
+        bool escaped_ = false;
+        /// Incomplete element or member of root container, or whole scalar root value.
+        std::string pending_;
+    };
+
+    /// Number of threads documents are parsed on, 0 for all hardware threads.
+    unsigned threads_ = 1;
+    /// State of document fed by Feed().
+    FeedState feed_;
 };
 
 }   // namespace ser
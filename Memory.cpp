@@ -0,0 +1,236 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "Memory.h"
+
+namespace ser
+{
+
+// ---------------------- MonotonicBufferResource ----------------------
+
+static size_t MonotonicBufferResource__Align(size_t size)
+{
+    return (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+}
+
+MonotonicBufferResource::MonotonicBufferResource(void* buffer, size_t size, MemoryResource* upstream)
+    : chunkSize_(64 * 1024)
+    , upstream_(upstream)
+{
+    // Serve only aligned part of the buffer
+    auto address = reinterpret_cast<uintptr_t>(buffer);
+    auto padding = MonotonicBufferResource__Align(address) - address;
+    if (buffer != nullptr && size > padding)
+    {
+        buffer_ = static_cast<char*>(buffer) + padding;
+        bufferSize_ = size - padding;
+    }
+    current_ = buffer_;
+    left_ = bufferSize_;
+}
+
+MonotonicBufferResource::MonotonicBufferResource(size_t chunkSize, MemoryResource* upstream)
+    : chunkSize_(chunkSize)
+    , upstream_(upstream)
+{
+}
+
+MonotonicBufferResource::~MonotonicBufferResource()
+{
+    Release();
+}
+
+void* MonotonicBufferResource::Allocate(size_t size)
+{
+    size = MonotonicBufferResource__Align(size);
+    if (size > left_)
+    {
+        const size_t header = MonotonicBufferResource__Align(sizeof(Chunk));
+        const size_t capacity = size > chunkSize_ ? size : chunkSize_;
+        auto* chunk = static_cast<Chunk*>(detail::Allocate(upstream_, header + capacity));
+        if (chunk == nullptr)
+            return nullptr;
+
+        chunk->next_ = chunks_;
+        chunks_ = chunk;
+        current_ = reinterpret_cast<char*>(chunk) + header;
+        left_ = capacity;
+    }
+
+    void* result = current_;
+    current_ += size;
+    left_ -= size;
+    return result;
+}
+
+void MonotonicBufferResource::Release()
+{
+    while (chunks_ != nullptr)
+    {
+        auto* next = chunks_->next_;
+        detail::Deallocate(chunks_);
+        chunks_ = next;
+    }
+    current_ = buffer_;
+    left_ = bufferSize_;
+}
+
+// ---------------------- MemoryResourceScope ----------------------
+
+static thread_local MemoryResource* MemoryResourceScope__current = nullptr;
+
+MemoryResourceScope::MemoryResourceScope(MemoryResource* resource)
+    : previous_(MemoryResourceScope__current)
+{
+    MemoryResourceScope__current = resource;
+}
+
+MemoryResourceScope::~MemoryResourceScope()
+{
+    MemoryResourceScope__current = previous_;
+}
+
+MemoryResource* MemoryResourceScope::Current()
+{
+    return MemoryResourceScope__current;
+}
+
+// ---------------------- detail ----------------------
+
+namespace detail
+{
+
+// Precedes every block returned by Allocate().
+struct alignas(std::max_align_t) BlockHeader
+{
+    MemoryResource* resource_;
+    size_t size_;
+    MemoryStats* stats_;
+};
+
+static void BlockHeader__Attach(BlockHeader* header, MemoryStats* stats)
+{
+    header->stats_ = stats;
+    if (stats == nullptr)
+        return;
+
+    stats->allocations_++;
+    stats->allocatedBytes_ += header->size_;
+    stats->currentBytes_ += header->size_;
+    if (stats->currentBytes_ > stats->peakBytes_)
+        stats->peakBytes_ = stats->currentBytes_;
+}
+
+static void BlockHeader__Detach(BlockHeader* header)
+{
+    if (header->stats_ != nullptr)
+        header->stats_->currentBytes_ -= header->size_;
+    header->stats_ = nullptr;
+}
+
+void* Allocate(MemoryResource* resource, size_t size, MemoryStats* stats)
+{
+    const size_t total = sizeof(BlockHeader) + size;
+    void* memory = resource != nullptr ? resource->Allocate(total) : malloc(total);
+    if (memory == nullptr)
+        return nullptr;
+
+    auto* header = static_cast<BlockHeader*>(memory);
+    header->resource_ = resource;
+    header->size_ = size;
+    BlockHeader__Attach(header, stats);
+    return header + 1;
+}
+
+void Deallocate(void* ptr)
+{
+    if (ptr == nullptr)
+        return;
+
+    auto* header = static_cast<BlockHeader*>(ptr) - 1;
+    BlockHeader__Detach(header);
+    if (header->resource_ != nullptr)
+        header->resource_->Deallocate(header, sizeof(BlockHeader) + header->size_);
+    else
+        free(header);
+}
+
+MemoryResource* GetBlockResource(void* ptr)
+{
+    return (static_cast<BlockHeader*>(ptr) - 1)->resource_;
+}
+
+size_t GetBlockSize(void* ptr)
+{
+    return (static_cast<BlockHeader*>(ptr) - 1)->size_;
+}
+
+void SetBlockStats(void* ptr, MemoryStats* stats)
+{
+    auto* header = static_cast<BlockHeader*>(ptr) - 1;
+    BlockHeader__Detach(header);
+    BlockHeader__Attach(header, stats);
+}
+
+static thread_local MemoryStats* MemoryStatsScope__current = nullptr;
+
+MemoryStatsScope::MemoryStatsScope(MemoryStats* stats)
+    : previous_(MemoryStatsScope__current)
+{
+    MemoryStatsScope__current = stats;
+}
+
+MemoryStatsScope::~MemoryStatsScope()
+{
+    MemoryStatsScope__current = previous_;
+}
+
+MemoryStats* MemoryStatsScope::Current()
+{
+    return MemoryStatsScope__current;
+}
+
+void* ResourceAllocator::Realloc(void* originalPtr, size_t originalSize, size_t newSize)
+{
+    if (newSize == 0)
+    {
+        Deallocate(originalPtr);
+        return nullptr;
+    }
+
+    if (originalPtr != nullptr && newSize <= GetBlockSize(originalPtr))
+        return originalPtr;
+
+    void* result = Allocate(resource_, newSize, stats_);
+    if (result != nullptr && originalPtr != nullptr)
+    {
+        memcpy(result, originalPtr, originalSize < newSize ? originalSize : newSize);
+        Deallocate(originalPtr);
+    }
+    return result;
+}
+
+}   // namespace detail
+
+}   // namespace ser
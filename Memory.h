@@ -0,0 +1,246 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <cstddef>
+#include <new>
+
+
+namespace ser
+{
+
+/// Memory usage of a single archive. Bytes are counted as requested by archive, excluding bookkeeping overhead.
+struct MemoryStats
+{
+    /// Number of allocations made.
+    size_t allocations_ = 0;
+    /// Total amount of bytes allocated.
+    size_t allocatedBytes_ = 0;
+    /// Amount of bytes currently allocated.
+    size_t currentBytes_ = 0;
+    /// Highest amount of bytes allocated at once.
+    size_t peakBytes_ = 0;
+};
+
+/// Source of memory for archives. Follows std::pmr::memory_resource, which is not available in C++14. All blocks must
+/// be aligned for any type.
+class MemoryResource
+{
+public:
+    virtual ~MemoryResource() = default;
+    /// Allocate a block of specified size. Returns null on failure.
+    virtual void* Allocate(size_t size) = 0;
+    /// Free a block previously returned by Allocate().
+    virtual void Deallocate(void* ptr, size_t size) = 0;
+};
+
+/// Hands out memory from a user-supplied buffer, falling back to chunks from upstream resource (or heap if it is null)
+/// when buffer is exhausted. Individual blocks are never freed, memory is reclaimed all at once by Release() or when
+/// resource is destroyed. Useful for serializing from a stack buffer or a per-thread arena.
+class MonotonicBufferResource : public MemoryResource
+{
+public:
+    /// Construct resource that serves memory from specified buffer first.
+    MonotonicBufferResource(void* buffer, size_t size, MemoryResource* upstream = nullptr);
+    /// Construct resource that serves memory from upstream chunks of specified size.
+    explicit MonotonicBufferResource(size_t chunkSize = 64 * 1024, MemoryResource* upstream = nullptr);
+    MonotonicBufferResource(const MonotonicBufferResource& other) = delete;
+    MonotonicBufferResource& operator=(const MonotonicBufferResource& other) = delete;
+    /// Free all upstream chunks.
+    ~MonotonicBufferResource() override;
+
+    void* Allocate(size_t size) override;
+    void Deallocate(void* /*ptr*/, size_t /*size*/) override { }
+    /// Free all upstream chunks and start serving memory from the beginning of user buffer again.
+    void Release();
+
+private:
+    /// Header of a chunk allocated from upstream.
+    struct Chunk
+    {
+        Chunk* next_;
+    };
+
+    /// User-supplied buffer.
+    char* buffer_ = nullptr;
+    /// Size of user-supplied buffer.
+    size_t bufferSize_ = 0;
+    /// Start of free memory in current chunk.
+    char* current_ = nullptr;
+    /// Bytes left in current chunk.
+    size_t left_ = 0;
+    /// Chunks allocated from upstream, most recent first.
+    Chunk* chunks_ = nullptr;
+    /// Minimal size of upstream chunk.
+    size_t chunkSize_ = 0;
+    /// Resource used when user buffer is exhausted.
+    MemoryResource* upstream_ = nullptr;
+};
+
+/// Makes a resource current resource of calling thread for the lifetime of this object. Archives constructed while a
+/// scope is active allocate from its resource by default. XML archives make their own resource current whenever they
+/// allocate, since pugixml only supports process-wide allocation functions. Memory is returned to the resource it came
+/// from, therefore resource must outlive everything that was allocated from it.
+class MemoryResourceScope
+{
+public:
+    /// Make specified resource current. Null resource means heap.
+    explicit MemoryResourceScope(MemoryResource* resource);
+    MemoryResourceScope(const MemoryResourceScope& other) = delete;
+    MemoryResourceScope& operator=(const MemoryResourceScope& other) = delete;
+    /// Restore previously current resource.
+    ~MemoryResourceScope();
+
+    /// Returns current resource of calling thread or null if heap is used.
+    static MemoryResource* Current();
+
+private:
+    /// Resource that was current before this scope.
+    MemoryResource* previous_ = nullptr;
+};
+
+namespace detail
+{
+
+/// Allocate a block from specified resource or heap if resource is null. Block remembers where it came from, therefore
+/// it can be freed with Deallocate() alone. Block is accounted in specified stats, unless they are null.
+void* Allocate(MemoryResource* resource, size_t size, MemoryStats* stats = nullptr);
+/// Free a block returned by Allocate().
+void Deallocate(void* ptr);
+/// Returns resource that block returned by Allocate() came from.
+MemoryResource* GetBlockResource(void* ptr);
+/// Returns size of block returned by Allocate().
+size_t GetBlockSize(void* ptr);
+/// Move accounting of block returned by Allocate() to specified stats, or stop accounting it if stats are null. Used
+/// when blocks are pooled.
+void SetBlockStats(void* ptr, MemoryStats* stats);
+
+/// Makes stats current stats of calling thread for the lifetime of this object. Memory allocated by pugixml documents
+/// and by ScopeAllocator is accounted in current stats, as these allocate without knowing which archive they serve.
+class MemoryStatsScope
+{
+public:
+    /// Make specified stats current. Null stats disable accounting.
+    explicit MemoryStatsScope(MemoryStats* stats);
+    MemoryStatsScope(const MemoryStatsScope& other) = delete;
+    MemoryStatsScope& operator=(const MemoryStatsScope& other) = delete;
+    /// Restore previously current stats.
+    ~MemoryStatsScope();
+
+    /// Returns current stats of calling thread or null.
+    static MemoryStats* Current();
+
+private:
+    /// Stats that were current before this scope.
+    MemoryStats* previous_ = nullptr;
+};
+
+/// Implements rapidjson allocator concept on top of MemoryResource.
+class ResourceAllocator
+{
+public:
+    static const bool kNeedFree = true;
+
+    explicit ResourceAllocator(MemoryResource* resource = nullptr, MemoryStats* stats = nullptr)
+        : resource_(resource)
+        , stats_(stats)
+    {
+    }
+
+    void* Malloc(size_t size) { return size ? Allocate(resource_, size, stats_) : nullptr; }
+    void* Realloc(void* originalPtr, size_t originalSize, size_t newSize);
+    static void Free(void* ptr) { Deallocate(ptr); }
+
+    /// Resource memory is allocated from.
+    MemoryResource* resource_ = nullptr;
+    /// Stats allocations are accounted in.
+    MemoryStats* stats_ = nullptr;
+};
+
+/// Standard library allocator which allocates from current resource of calling thread and accounts memory in current
+/// stats, just like pugixml documents do.
+template<typename T>
+class ScopeAllocator
+{
+public:
+    using value_type = T;
+
+    ScopeAllocator() = default;
+    template<typename U>
+    ScopeAllocator(const ScopeAllocator<U>& /*other*/) { }  // NOLINT(google-explicit-constructor)
+
+    T* allocate(size_t n)
+    {
+        if (void* ptr = Allocate(MemoryResourceScope::Current(), n * sizeof(T), MemoryStatsScope::Current()))
+            return static_cast<T*>(ptr);
+        throw std::bad_alloc();
+    }
+    void deallocate(T* ptr, size_t /*n*/) { Deallocate(ptr); }
+
+    template<typename U>
+    bool operator==(const ScopeAllocator<U>& other) const { return true; }
+    template<typename U>
+    bool operator!=(const ScopeAllocator<U>& other) const { return false; }
+};
+
+/// Standard library allocator which allocates from resource of specified ResourceAllocator and accounts memory in its
+/// stats. Lookup structures of archives use it to allocate from memory of their archive, whatever resource is current.
+template<typename T>
+class ArchiveAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ArchiveAllocator(const ResourceAllocator* allocator)
+        : allocator_(allocator)
+    {
+    }
+    template<typename U>
+    ArchiveAllocator(const ArchiveAllocator<U>& other) : allocator_(other.allocator_) { }  // NOLINT(google-explicit-constructor)
+
+    T* allocate(size_t n)
+    {
+        if (void* ptr = Allocate(allocator_->resource_, n * sizeof(T), allocator_->stats_))
+            return static_cast<T*>(ptr);
+        throw std::bad_alloc();
+    }
+    void deallocate(T* ptr, size_t /*n*/) { Deallocate(ptr); }
+
+    template<typename U>
+    bool operator==(const ArchiveAllocator<U>& other) const { return allocator_ == other.allocator_; }
+    template<typename U>
+    bool operator!=(const ArchiveAllocator<U>& other) const { return allocator_ != other.allocator_; }
+
+    /// Allocator of archive memory is allocated from.
+    const ResourceAllocator* allocator_;
+};
+
+/// Deleter for pointers to blocks returned by Allocate().
+struct BlockDeleter
+{
+    void operator()(void* ptr) const { Deallocate(ptr); }
+};
+
+}   // namespace detail
+
+}   // namespace ser
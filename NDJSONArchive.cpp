@@ -0,0 +1,245 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "rapidjson/memorystream.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "NDJSONArchive.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "Tracer.h"
+
+namespace ser
+{
+
+// Smallest amount of input worth parsing on a separate thread.
+static const size_t NDJSONArchive__MinChunkBytes = 64 * 1024;
+
+using NDJSONArchive__StringBuffer = rapidjson::GenericStringBuffer<rapidjson::UTF8<>>;
+
+// ---------------------- NDJSONOutputArchive ----------------------
+
+NDJSONOutputArchive::NDJSONOutputArchive(MemoryResource* resource)
+    : JSONOutputArchive(resource)
+{
+}
+
+NDJSONOutputArchive::NDJSONOutputArchive(void* buffer, size_t size, MemoryResource* resource)
+    : JSONOutputArchive(buffer, size, resource)
+{
+}
+
+static void NDJSONOutputArchive__WriteRecords(NDJSONArchive__StringBuffer& buffer, const JSONArchive::Value* begin,
+    const JSONArchive::Value* end)
+{
+    rapidjson::Writer<NDJSONArchive__StringBuffer> writer(buffer);
+    for (auto* record = begin; record != end; ++record)
+    {
+        // Writer accepts a single root value only
+        writer.Reset(buffer);
+        record->Accept(writer);
+        buffer.Put('\n');
+    }
+}
+
+// Format records of specified root into buffers, one per chunk of records. Document is only read, therefore chunks can
+// be formatted concurrently.
+static void NDJSONOutputArchive__Format(const JSONArchive::Value& root, unsigned threads,
+    std::vector<NDJSONArchive__StringBuffer>& buffers)
+{
+    if (root.IsArray())
+    {
+        const auto* records = root.Begin();
+        const unsigned chunks = detail::GetParallelChunks(root.Size(), threads);
+        buffers.resize(chunks);
+        detail::ParallelForChunks(root.Size(), chunks, [&](unsigned chunk, size_t begin, size_t end) {
+            NDJSONOutputArchive__WriteRecords(buffers[chunk], records + begin, records + end);
+        });
+    }
+    else if (!root.IsNull())
+    {
+        const JSONArchive::Value* record = &root;
+        buffers.resize(1);
+        NDJSONOutputArchive__WriteRecords(buffers[0], record, record + 1);
+    }
+}
+
+std::string NDJSONOutputArchive::ToString() const
+{
+    detail::TraceScope traceScope("archive", "ToString", 8);
+    detail::Stopwatch stopwatch;
+    std::vector<NDJSONArchive__StringBuffer> buffers;
+    NDJSONOutputArchive__Format(root_, threads_, buffers);
+
+    size_t size = 0;
+    for (const auto& buffer : buffers)
+        size += buffer.GetSize();
+    std::string result;
+    result.reserve(size);
+    for (const auto& buffer : buffers)
+        result.append(buffer.GetString(), buffer.GetSize());
+
+    detail::CountMetric(detail::JSONMetrics, detail::BytesOutCounter, result.size());
+    detail::RecordLatency(detail::JSONMetrics, detail::ToStringLatency, stopwatch.Elapsed());
+    return result;
+}
+
+bool NDJSONOutputArchive::Save(Sink& sink) const
+{
+    detail::TraceScope traceScope("archive", "Save", 4);
+    detail::Stopwatch stopwatch;
+    std::vector<NDJSONArchive__StringBuffer> buffers;
+    NDJSONOutputArchive__Format(root_, threads_, buffers);
+
+    size_t size = 0;
+    bool written = true;
+    for (const auto& buffer : buffers)
+    {
+        written = sink.Write(buffer.GetString(), buffer.GetSize()) && written;
+        size += buffer.GetSize();
+    }
+
+    detail::CountMetric(detail::JSONMetrics, detail::BytesOutCounter, size);
+    detail::RecordLatency(detail::JSONMetrics, detail::ToStringLatency, stopwatch.Elapsed());
+    return written;
+}
+
+// ---------------------- NDJSONInputArchive ----------------------
+
+NDJSONInputArchive::NDJSONInputArchive(MemoryResource* resource)
+    : JSONInputArchive(resource)
+{
+    threads_ = 0;
+}
+
+NDJSONInputArchive::NDJSONInputArchive(const std::string& data, MemoryResource* resource)
+    : JSONInputArchive(resource)
+{
+    threads_ = 0;
+    Load(data);
+}
+
+// Parses a single line into document passed to Document::Populate(). Reader is shared by all lines, so that its stack
+// is allocated once.
+struct NDJSONInputArchive__LineParser
+{
+    rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::UTF8<>, detail::ResourceAllocator>& reader_;
+    rapidjson::MemoryStream stream_;
+
+    bool operator()(JSONArchive::Document& handler)
+    {
+        return !reader_.Parse(stream_, handler).IsError();
+    }
+};
+
+bool NDJSONInputArchive::ParseRecords(const char* begin, const char* end)
+{
+    // Records are parsed into a document sharing allocator of this archive, then moved into root array
+    Document record(&allocator_, 1024, &baseAllocator_);
+    rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::UTF8<>, detail::ResourceAllocator> reader(&baseAllocator_);
+    while (begin < end)
+    {
+        auto* lineEnd = static_cast<const char*>(memchr(begin, '\n', (size_t)(end - begin)));
+        if (lineEnd == nullptr)
+            lineEnd = end;
+
+        auto* first = begin;
+        while (first < lineEnd && (*first == ' ' || *first == '\t' || *first == '\r'))
+            first++;
+
+        if (first < lineEnd)
+        {
+            NDJSONInputArchive__LineParser parser{reader, rapidjson::MemoryStream(first, (size_t)(lineEnd - first))};
+            record.Populate(parser);
+            if (reader.HasParseError())
+                return false;
+            root_.PushBack(static_cast<Value&>(record), allocator_);
+        }
+        begin = lineEnd + 1;
+    }
+    return true;
+}
+
+// Returns position of beginning of line following the line at specified position.
+static size_t NDJSONInputArchive__NextLine(const char* data, size_t size, size_t position)
+{
+    if (position >= size)
+        return size;
+
+    auto* end = static_cast<const char*>(memchr(data + position, '\n', size - position));
+    return end == nullptr ? size : (size_t)(end - data) + 1;
+}
+
+bool NDJSONInputArchive::Parse(const char* data, size_t size, bool /*terminated*/)
+{
+    detail::TraceScope traceScope("archive", "Parse", 5);
+    detail::Stopwatch stopwatch;
+    index_.clear();
+    root_.SetArray();
+    ReleaseFragments();
+
+    bool result = true;
+    const unsigned chunks = detail::GetParallelChunks(size, threads_, NDJSONArchive__MinChunkBytes);
+    if (chunks < 2)
+        result = ParseRecords(data, data + size);
+    else
+    {
+        // Chunks of roughly equal size, each starting at beginning of a line
+        std::vector<size_t> bounds(chunks + 1, size);
+        bounds[0] = 0;
+        for (unsigned chunk = 1; chunk < chunks; chunk++)
+            bounds[chunk] = NDJSONInputArchive__NextLine(data, size, std::max(bounds[chunk - 1], size * chunk / chunks));
+
+        // Memory resources are not thread-safe, therefore fragments allocate from heap
+        std::vector<std::unique_ptr<NDJSONInputArchive>> fragments(chunks);
+        std::vector<char> results(chunks);
+        detail::ParallelFor(chunks, [&](unsigned chunk) {
+            fragments[chunk].reset(new NDJSONInputArchive(nullptr));
+            fragments[chunk]->root_.SetArray();
+            results[chunk] = fragments[chunk]->ParseRecords(data + bounds[chunk], data + bounds[chunk + 1]);
+        });
+
+        rapidjson::SizeType count = 0;
+        for (const auto& fragment : fragments)
+            count += fragment->root_.Size();
+        root_.Reserve(count, allocator_);
+
+        // Moving a value copies its handle only, memory it points to stays in the fragment
+        for (unsigned chunk = 0; chunk < chunks; chunk++)
+        {
+            auto& fragment = fragments[chunk];
+            for (auto* record = fragment->root_.Begin(); record != fragment->root_.End(); ++record)
+                root_.PushBack(*record, allocator_);
+            result = result && results[chunk] != 0;
+            AdoptFragment(std::move(fragment));
+        }
+    }
+
+    detail::CountMetric(detail::JSONMetrics, detail::BytesInCounter, size);
+    detail::RecordLatency(detail::JSONMetrics, detail::ParseLatency, stopwatch.Elapsed());
+    return result;
+}
+
+}   // namespace ser
@@ -0,0 +1,81 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <string>
+#include "JSONArchive.h"
+
+
+namespace ser
+{
+
+/// Writes newline-delimited JSON (JSON Lines). Elements of root array are records, each of them is written on a line
+/// of its own.
+class NDJSONOutputArchive : public JSONOutputArchive
+{
+public:
+    /// Construct archive which allocates memory from specified resource, or heap if it is null.
+    explicit NDJSONOutputArchive(MemoryResource* resource = MemoryResourceScope::Current());
+    /// Construct archive which allocates memory from specified buffer first, then from specified resource.
+    NDJSONOutputArchive(void* buffer, size_t size, MemoryResource* resource = MemoryResourceScope::Current());
+
+    /// Set number of threads records are formatted on, 0 for all hardware threads.
+    void SetThreads(unsigned threads) { threads_ = threads; }
+    /// Return records in compact form, each of them terminated by a newline. Chunks of records are formatted on
+    /// multiple threads and concatenated in order. Root value that is not an array is written as a single record.
+    std::string ToString() const override;
+    /// Return records the same way as ToString(). Size of output is known before it is copied into the string, therefore
+    /// size hint is not needed.
+    std::string ToString(size_t /*sizeHint*/) const override { return ToString(); }
+    /// Write records to specified sink, chunk by chunk in order. Output is the same as ToString(). Returns false if sink
+    /// failed to write.
+    bool Save(Sink& sink) const override;
+
+protected:
+    /// Number of threads records are formatted on, 0 for all hardware threads.
+    unsigned threads_ = 0;
+};
+
+/// Reads newline-delimited JSON (JSON Lines). Records are exposed as elements of root array. Empty lines are skipped.
+/// Records are parsed on all hardware threads unless SetThreads() says otherwise.
+class NDJSONInputArchive : public JSONInputArchive
+{
+public:
+    /// Construct empty input archive which allocates memory from specified resource, or heap if it is null. Use Load()
+    /// to read records.
+    explicit NDJSONInputArchive(MemoryResource* resource = MemoryResourceScope::Current());
+    /// Construct input archive that will read specified records.
+    explicit NDJSONInputArchive(const std::string& data, MemoryResource* resource = MemoryResourceScope::Current());
+
+protected:
+    /// Parse records in specified memory range into root array, replacing previous ones. Load() overloads of base class
+    /// parse through it, therefore records are parsed as NDJSON even through a reference to JSONInputArchive. Input is
+    /// split on line boundaries into chunks which are parsed on multiple threads and spliced into root array in order.
+    /// Returns false if any record is malformed.
+    bool Parse(const char* data, size_t size, bool terminated) override;
+    /// Parse lines in range [begin, end) and append their records to root array. Returns false if any record is
+    /// malformed.
+    bool ParseRecords(const char* begin, const char* end);
+};
+
+}   // namespace ser
@@ -0,0 +1,78 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+
+namespace ser
+{
+
+namespace detail
+{
+
+/// Smallest amount of elements worth serializing on a separate thread.
+static const size_t ParallelMinChunk = 1024;
+
+/// Returns number of chunks a range of specified size is split into when processed on specified number of threads,
+/// or on all hardware threads if it is 0. Chunks are not smaller than specified size, ranges that do not benefit from
+/// threading are not split.
+inline unsigned GetParallelChunks(size_t count, unsigned threads, size_t minChunk = ParallelMinChunk)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    const size_t useful = count / minChunk;
+    return useful < threads ? (unsigned)(useful > 0 ? useful : 1) : (threads > 0 ? threads : 1);
+}
+
+/// Call function(task) for each task in range [0, tasks) on a separate thread. First task runs on calling thread.
+/// Returns when all tasks are done.
+template<typename Function>
+void ParallelFor(unsigned tasks, const Function& function)
+{
+    std::vector<std::thread> workers;
+    workers.reserve(tasks > 0 ? tasks - 1 : 0);
+    for (unsigned task = 1; task < tasks; task++)
+        workers.emplace_back([&function, task]() { function(task); });
+
+    if (tasks > 0)
+        function(0u);
+    for (auto& worker : workers)
+        worker.join();
+}
+
+/// Split range [0, count) into specified number of contiguous chunks and call function(chunk, begin, end) for each of
+/// them on a separate thread. Returns when all chunks are done.
+template<typename Function>
+void ParallelForChunks(size_t count, unsigned chunks, const Function& function)
+{
+    ParallelFor(chunks, [&function, count, chunks](unsigned chunk) {
+        function(chunk, count * chunk / chunks, count * (chunk + 1) / chunks);
+    });
+}
+
+}   // namespace detail
+
+}   // namespace ser
@@ -0,0 +1,72 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <cstddef>
+#include <string>
+
+
+namespace ser
+{
+
+namespace detail
+{
+
+/// Append a reference token to a JSON Pointer (RFC 6901), escaping '~' and '/'.
+inline void AppendPathToken(std::string& path, const char* token, size_t length)
+{
+    path += '/';
+    for (size_t i = 0; i < length; i++)
+    {
+        if (token[i] == '~')
+            path += "~0";
+        else if (token[i] == '/')
+            path += "~1";
+        else
+            path += token[i];
+    }
+}
+
+/// Read next reference token of a JSON Pointer starting at specified position, unescape it into token and advance
+/// position past it. Returns false if there are no more tokens or pointer is malformed.
+inline bool NextPathToken(const std::string& path, size_t& position, std::string& token)
+{
+    if (position >= path.size() || path[position] != '/')
+        return false;
+
+    token.clear();
+    for (position++; position < path.size() && path[position] != '/'; position++)
+    {
+        if (path[position] != '~')
+            token += path[position];
+        else if (position + 1 < path.size() && (path[position + 1] == '0' || path[position + 1] == '1'))
+            token += path[++position] == '0' ? '~' : '/';
+        else
+            return false;
+    }
+    return true;
+}
+
+}   // namespace detail
+
+}   // namespace ser
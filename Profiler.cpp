@@ -0,0 +1,271 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "Profiler.h"
+
+namespace ser
+{
+
+// ---------------------- Metrics ----------------------
+
+// Counters of a single thread. Only owning thread writes them, relaxed atomics keep concurrent snapshots well-defined
+// without making updates any more expensive than plain increments.
+struct Profiler__ThreadMetrics
+{
+    std::atomic<uint64_t> counters_[detail::MetricsFormatCount][detail::MetricsCounterCount];
+    std::atomic<uint64_t> buckets_[detail::MetricsFormatCount][detail::MetricsLatencyCount][LatencyBucketCount];
+    std::atomic<uint64_t> count_[detail::MetricsFormatCount][detail::MetricsLatencyCount];
+    std::atomic<uint64_t> nanoseconds_[detail::MetricsFormatCount][detail::MetricsLatencyCount];
+};
+
+static void Profiler__Increment(std::atomic<uint64_t>& counter, uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Counters of live threads, and sum of counters of threads that exited.
+struct Profiler__MetricsRegistry
+{
+    std::mutex mutex_;
+    std::vector<Profiler__ThreadMetrics*> threads_;
+    Profiler__ThreadMetrics exited_{};
+};
+
+static Profiler__MetricsRegistry& Profiler__GetMetricsRegistry()
+{
+    static Profiler__MetricsRegistry registry;
+    return registry;
+}
+
+static void Profiler__Accumulate(const Profiler__ThreadMetrics& source, Profiler__ThreadMetrics& target)
+{
+    auto add = [](const std::atomic<uint64_t>& from, std::atomic<uint64_t>& to) {
+        Profiler__Increment(to, from.load(std::memory_order_relaxed));
+    };
+
+    for (unsigned format = 0; format < detail::MetricsFormatCount; format++)
+    {
+        for (unsigned counter = 0; counter < detail::MetricsCounterCount; counter++)
+            add(source.counters_[format][counter], target.counters_[format][counter]);
+
+        for (unsigned latency = 0; latency < detail::MetricsLatencyCount; latency++)
+        {
+            for (unsigned bucket = 0; bucket < LatencyBucketCount; bucket++)
+                add(source.buckets_[format][latency][bucket], target.buckets_[format][latency][bucket]);
+            add(source.count_[format][latency], target.count_[format][latency]);
+            add(source.nanoseconds_[format][latency], target.nanoseconds_[format][latency]);
+        }
+    }
+}
+
+// Registers counters of a thread for its lifetime.
+struct Profiler__ThreadMetricsHolder
+{
+    Profiler__ThreadMetricsHolder()
+    {
+        auto& registry = Profiler__GetMetricsRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex_);
+        registry.threads_.push_back(&metrics_);
+    }
+
+    ~Profiler__ThreadMetricsHolder()
+    {
+        auto& registry = Profiler__GetMetricsRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex_);
+        Profiler__Accumulate(metrics_, registry.exited_);
+        registry.threads_.erase(std::find(registry.threads_.begin(), registry.threads_.end(), &metrics_));
+    }
+
+    Profiler__ThreadMetrics metrics_{};
+};
+
+static Profiler__ThreadMetrics& Profiler__GetThreadMetrics()
+{
+    static thread_local Profiler__ThreadMetricsHolder holder;
+    return holder.metrics_;
+}
+
+void detail::CountMetric(MetricsFormat format, MetricsCounter counter, uint64_t value)
+{
+    Profiler__Increment(Profiler__GetThreadMetrics().counters_[format][counter], value);
+}
+
+void detail::RecordLatency(MetricsFormat format, MetricsLatency latency, uint64_t nanoseconds)
+{
+    unsigned bucket = 0;
+    for (uint64_t remaining = nanoseconds; remaining != 0 && bucket < LatencyBucketCount - 1; remaining >>= 1u)
+        bucket++;
+
+    auto& metrics = Profiler__GetThreadMetrics();
+    Profiler__Increment(metrics.buckets_[format][latency][bucket], 1);
+    Profiler__Increment(metrics.count_[format][latency], 1);
+    Profiler__Increment(metrics.nanoseconds_[format][latency], nanoseconds);
+}
+
+uint64_t LatencyHistogram::Percentile(double fraction) const
+{
+    if (count_ == 0)
+        return 0;
+
+    auto threshold = (uint64_t)(fraction * (double)count_ + 0.5);
+    uint64_t seen = 0;
+    for (unsigned bucket = 0; bucket < LatencyBucketCount; bucket++)
+    {
+        seen += buckets_[bucket];
+        if (seen >= threshold && seen > 0)
+            return bucket == 0 ? 0 : (uint64_t)1 << bucket;
+    }
+    return (uint64_t)1 << LatencyBucketCount;
+}
+
+static void Profiler__Snapshot(const Profiler__ThreadMetrics& source, detail::MetricsFormat format, ArchiveMetrics& target)
+{
+    const auto& counters = source.counters_[format];
+    target.begins_ = counters[detail::BeginCounter].load(std::memory_order_relaxed);
+    target.serializes_ = counters[detail::SerializeCounter].load(std::memory_order_relaxed);
+    target.finds_ = counters[detail::FindCounter].load(std::memory_order_relaxed);
+    target.findMisses_ = counters[detail::FindMissCounter].load(std::memory_order_relaxed);
+    target.cacheHits_ = counters[detail::CacheHitCounter].load(std::memory_order_relaxed);
+    target.cacheMisses_ = counters[detail::CacheMissCounter].load(std::memory_order_relaxed);
+    target.bytesIn_ = counters[detail::BytesInCounter].load(std::memory_order_relaxed);
+    target.bytesOut_ = counters[detail::BytesOutCounter].load(std::memory_order_relaxed);
+
+    LatencyHistogram* histograms[detail::MetricsLatencyCount] = {&target.toString_, &target.parse_};
+    for (unsigned latency = 0; latency < detail::MetricsLatencyCount; latency++)
+    {
+        auto& histogram = *histograms[latency];
+        for (unsigned bucket = 0; bucket < LatencyBucketCount; bucket++)
+            histogram.buckets_[bucket] = source.buckets_[format][latency][bucket].load(std::memory_order_relaxed);
+        histogram.count_ = source.count_[format][latency].load(std::memory_order_relaxed);
+        histogram.nanoseconds_ = source.nanoseconds_[format][latency].load(std::memory_order_relaxed);
+    }
+}
+
+MetricsSnapshot GetMetrics()
+{
+    Profiler__ThreadMetrics total{};
+    {
+        auto& registry = Profiler__GetMetricsRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex_);
+        Profiler__Accumulate(registry.exited_, total);
+        for (const auto* thread : registry.threads_)
+            Profiler__Accumulate(*thread, total);
+    }
+
+    MetricsSnapshot snapshot;
+    Profiler__Snapshot(total, detail::JSONMetrics, snapshot.json_);
+    Profiler__Snapshot(total, detail::XMLMetrics, snapshot.xml_);
+    return snapshot;
+}
+
+// ---------------------- UserTypeCounters ----------------------
+
+// Counters are never removed, so that archives may keep pointers to them.
+struct Profiler__Registry
+{
+    std::mutex mutex_;
+    std::deque<detail::UserTypeCounters> counters_;
+};
+
+static Profiler__Registry& Profiler__GetRegistry()
+{
+    static Profiler__Registry registry;
+    return registry;
+}
+
+detail::UserTypeCounters* detail::RegisterUserTypeCounters(const char* archive, const char* type)
+{
+    auto& registry = Profiler__GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex_);
+    registry.counters_.emplace_back();
+
+    auto& counters = registry.counters_.back();
+    counters.archive_ = archive;
+    counters.type_ = type != nullptr ? type : "?";
+    counters.calls_ = 0;
+    counters.nanoseconds_ = 0;
+    counters.bytes_ = 0;
+    return &counters;
+}
+
+std::vector<UserTypeProfile> GetUserTypeProfiles()
+{
+    std::vector<UserTypeProfile> result;
+    {
+        auto& registry = Profiler__GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex_);
+        for (const auto& counters : registry.counters_)
+        {
+            UserTypeProfile profile;
+            profile.archive_ = counters.archive_;
+            profile.type_ = counters.type_;
+            profile.calls_ = counters.calls_.load(std::memory_order_relaxed);
+            profile.nanoseconds_ = counters.nanoseconds_.load(std::memory_order_relaxed);
+            profile.bytes_ = counters.bytes_.load(std::memory_order_relaxed);
+            result.push_back(std::move(profile));
+        }
+    }
+
+    std::stable_sort(result.begin(), result.end(), [](const UserTypeProfile& a, const UserTypeProfile& b) {
+        return a.nanoseconds_ > b.nanoseconds_;
+    });
+    return result;
+}
+
+std::string GetUserTypeProfileReport()
+{
+    auto profiles = GetUserTypeProfiles();
+    if (profiles.empty())
+        return {};
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-24s %-32s %12s %14s %12s %14s\n", "archive", "type", "calls", "total ms", "ns/call",
+        "bytes");
+    std::string report = line;
+    for (const auto& profile : profiles)
+    {
+        double nsPerCall = profile.calls_ ? (double)profile.nanoseconds_ / (double)profile.calls_ : 0.0;
+        snprintf(line, sizeof(line), "%-24s %-32s %12llu %14.3f %12.1f %14llu\n", profile.archive_.c_str(),
+            profile.type_.c_str(), (unsigned long long)profile.calls_, (double)profile.nanoseconds_ / 1e6, nsPerCall,
+            (unsigned long long)profile.bytes_);
+        report += line;
+    }
+    return report;
+}
+
+void ResetUserTypeProfiles()
+{
+    auto& registry = Profiler__GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex_);
+    for (auto& counters : registry.counters_)
+    {
+        counters.calls_ = 0;
+        counters.nanoseconds_ = 0;
+        counters.bytes_ = 0;
+    }
+}
+
+}   // namespace ser
@@ -0,0 +1,192 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace ser
+{
+
+/// Number of buckets of latency histograms.
+static const unsigned LatencyBucketCount = 48;
+
+/// Latencies of an operation, bucketed by powers of two.
+struct LatencyHistogram
+{
+    /// Bucket 0 counts operations that took no time, bucket i counts operations that took [2^(i-1), 2^i) nanoseconds.
+    uint64_t buckets_[LatencyBucketCount]{};
+    /// Number of operations.
+    uint64_t count_ = 0;
+    /// Total time of operations in nanoseconds.
+    uint64_t nanoseconds_ = 0;
+
+    /// Returns upper bound of latency in nanoseconds that specified fraction (0 to 1) of operations did not exceed.
+    uint64_t Percentile(double fraction) const;
+};
+
+/// Operation counters of a single archive format.
+struct ArchiveMetrics
+{
+    /// Number of containers begun.
+    uint64_t begins_ = 0;
+    /// Number of values serialized, excluding user types and containers.
+    uint64_t serializes_ = 0;
+    /// Number of key lookups.
+    uint64_t finds_ = 0;
+    /// Number of key lookups that found no existing key. Output archives add a new key in this case.
+    uint64_t findMisses_ = 0;
+    /// Number of user objects output archives spliced from SerializationCache.
+    uint64_t cacheHits_ = 0;
+    /// Number of user objects output archives serialized and stored into SerializationCache.
+    uint64_t cacheMisses_ = 0;
+    /// Amount of bytes parsed by input archives.
+    uint64_t bytesIn_ = 0;
+    /// Amount of bytes produced by ToString() of output archives.
+    uint64_t bytesOut_ = 0;
+    /// Latencies of ToString() of output archives.
+    LatencyHistogram toString_;
+    /// Latencies of parsing by input archives.
+    LatencyHistogram parse_;
+};
+
+/// Counters of all archives, aggregated over all threads.
+struct MetricsSnapshot
+{
+    /// JSON archives.
+    ArchiveMetrics json_;
+    /// XML archives.
+    ArchiveMetrics xml_;
+};
+
+/// Returns counters of all archives accumulated since program start, including threads that already exited. Archives
+/// update counters of their own thread, therefore counters are cheap to update and may be read at any time.
+MetricsSnapshot GetMetrics();
+
+/// Counters of a single user type serialized by a single archive type. Times and sizes of user types that serialize
+/// other user types include those nested values.
+struct UserTypeProfile
+{
+    /// Name of archive class.
+    std::string archive_;
+    /// Name of user type as it was passed to SER_USER_TYPE_SERIALIZER().
+    std::string type_;
+    /// Number of serializer calls.
+    uint64_t calls_ = 0;
+    /// Total time spent in serializer.
+    uint64_t nanoseconds_ = 0;
+    /// Total size of serialized values in compact form. Output archives produce these bytes, input archives consume them.
+    uint64_t bytes_ = 0;
+};
+
+/// Returns counters of all registered user types, most expensive first. Counters are collected only when library is
+/// built with SER_PROFILE_USER_TYPES defined, otherwise result is empty.
+std::vector<UserTypeProfile> GetUserTypeProfiles();
+/// Returns counters of all registered user types as a table, or empty string if there are none.
+std::string GetUserTypeProfileReport();
+/// Zero counters of all registered user types.
+void ResetUserTypeProfiles();
+
+namespace detail
+{
+
+/// Archive formats that keep metrics.
+enum MetricsFormat
+{
+    JSONMetrics,
+    XMLMetrics,
+    MetricsFormatCount,
+};
+
+/// Counters of ArchiveMetrics.
+enum MetricsCounter
+{
+    BeginCounter,
+    SerializeCounter,
+    FindCounter,
+    FindMissCounter,
+    CacheHitCounter,
+    CacheMissCounter,
+    BytesInCounter,
+    BytesOutCounter,
+    MetricsCounterCount,
+};
+
+/// Histograms of ArchiveMetrics.
+enum MetricsLatency
+{
+    ToStringLatency,
+    ParseLatency,
+    MetricsLatencyCount,
+};
+
+/// Add specified value to a counter of calling thread.
+void CountMetric(MetricsFormat format, MetricsCounter counter, uint64_t value = 1);
+/// Record latency of an operation in a histogram of calling thread.
+void RecordLatency(MetricsFormat format, MetricsLatency latency, uint64_t nanoseconds);
+
+/// Live counters of a user type, updated by all threads.
+struct UserTypeCounters
+{
+    const char* archive_;
+    const char* type_;
+    std::atomic<uint64_t> calls_;
+    std::atomic<uint64_t> nanoseconds_;
+    std::atomic<uint64_t> bytes_;
+
+    /// Account a single serializer call.
+    void Add(uint64_t nanoseconds, uint64_t bytes)
+    {
+        calls_.fetch_add(1, std::memory_order_relaxed);
+        nanoseconds_.fetch_add(nanoseconds, std::memory_order_relaxed);
+        bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+};
+
+/// Create counters of user type serialized by specified archive. Counters live until program exits.
+UserTypeCounters* RegisterUserTypeCounters(const char* archive, const char* type);
+
+/// Measures time since construction.
+class Stopwatch
+{
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) { }
+
+    /// Returns nanoseconds elapsed since construction.
+    uint64_t Elapsed() const
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+}   // namespace detail
+
+}   // namespace ser
@@ -0,0 +1,203 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <cassert>
+#include <cstring>
+#include "RecordStream.h"
+
+
+namespace ser
+{
+
+// Header of a record is its size, header of index has this bit set in addition.
+static const uint32_t RecordStream__IndexFlag = 0x80000000u;
+static const size_t RecordStream__HeaderSize = 4;
+// Trailer is offset of index header followed by magic.
+static const char RecordStream__Magic[4] = {'S', 'E', 'R', 'X'};
+static const size_t RecordStream__TrailerSize = 8 + sizeof(RecordStream__Magic);
+
+static void RecordStream__Write32(std::string& data, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        data.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+static void RecordStream__Write64(std::string& data, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        data.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+static uint32_t RecordStream__Read32(const char* data)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--)
+        value = (value << 8) | (uint8_t)data[i];
+    return value;
+}
+
+static uint64_t RecordStream__Read64(const char* data)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+        value = (value << 8) | (uint8_t)data[i];
+    return value;
+}
+
+// ---------------------- RecordWriter ----------------------
+
+size_t RecordWriter::Write(const void* data, size_t size)
+{
+    // Size of a larger record does not fit into its header
+    if (finished_ || size > MaxRecordSize)
+        return InvalidIndex;
+
+    offsets_.push_back(flushed_ + data_.size());
+    RecordStream__Write32(data_, (uint32_t)size);
+    data_.append(static_cast<const char*>(data), size);
+    return offsets_.size() - 1;
+}
+
+void RecordWriter::Finish()
+{
+    assert(!finished_);
+    const uint64_t indexOffset = flushed_ + data_.size();
+    const size_t indexSize = offsets_.size() * 8;
+    data_.reserve(data_.size() + RecordStream__HeaderSize + indexSize + RecordStream__TrailerSize);
+    RecordStream__Write32(data_, (uint32_t)indexSize | RecordStream__IndexFlag);
+    for (auto offset : offsets_)
+        RecordStream__Write64(data_, offset);
+    RecordStream__Write64(data_, indexOffset);
+    data_.append(RecordStream__Magic, sizeof(RecordStream__Magic));
+    finished_ = true;
+}
+
+std::string RecordWriter::Flush()
+{
+    std::string data;
+    data.swap(data_);
+    flushed_ += data.size();
+    return data;
+}
+
+void RecordWriter::Clear()
+{
+    data_.clear();
+    flushed_ = 0;
+    offsets_.clear();
+    finished_ = false;
+}
+
+// ---------------------- RecordReader ----------------------
+
+RecordReader::RecordReader(const void* data, size_t size)
+    : data_(static_cast<const char*>(data))
+{
+    // Index is trusted only if trailer, index header and index size all agree with each other
+    if (size >= RecordStream__HeaderSize + RecordStream__TrailerSize &&
+        memcmp(data_ + size - sizeof(RecordStream__Magic), RecordStream__Magic, sizeof(RecordStream__Magic)) == 0)
+    {
+        const uint64_t indexOffset = RecordStream__Read64(data_ + size - RecordStream__TrailerSize);
+        const size_t indexEnd = size - RecordStream__TrailerSize;
+        if (indexOffset <= indexEnd && indexEnd - indexOffset >= RecordStream__HeaderSize)
+        {
+            const uint32_t header = RecordStream__Read32(data_ + indexOffset);
+            const size_t indexSize = indexEnd - (size_t)indexOffset - RecordStream__HeaderSize;
+            if ((header & RecordStream__IndexFlag) != 0 && (header & ~RecordStream__IndexFlag) == indexSize &&
+                indexSize % 8 == 0)
+            {
+                recordsSize_ = (size_t)indexOffset;
+                index_ = data_ + indexOffset + RecordStream__HeaderSize;
+                count_ = indexSize / 8;
+                return;
+            }
+        }
+    }
+
+    // Without index records are located by following length prefixes until end of data or first damaged record
+    size_t offset = 0;
+    while (offset < size)
+    {
+        if (size - offset < RecordStream__HeaderSize)
+        {
+            valid_ = false;
+            break;
+        }
+        const uint32_t header = RecordStream__Read32(data_ + offset);
+        if ((header & RecordStream__IndexFlag) != 0 || size - offset - RecordStream__HeaderSize < header)
+        {
+            valid_ = false;
+            break;
+        }
+        offsets_.push_back(offset);
+        offset += RecordStream__HeaderSize + header;
+    }
+    recordsSize_ = offset;
+    count_ = offsets_.size();
+}
+
+RecordView RecordReader::Get(size_t index) const
+{
+    if (index >= count_)
+        return {};
+    return Read(index_ != nullptr ? RecordStream__Read64(index_ + index * 8) : offsets_[index]);
+}
+
+RecordView RecordReader::Read(uint64_t offset) const
+{
+    if (offset > recordsSize_ || recordsSize_ - offset < RecordStream__HeaderSize)
+        return {};
+    const uint32_t size = RecordStream__Read32(data_ + offset);
+    if ((size & RecordStream__IndexFlag) != 0 || recordsSize_ - offset - RecordStream__HeaderSize < size)
+        return {};
+
+    RecordView record;
+    record.data_ = data_ + offset + RecordStream__HeaderSize;
+    record.size_ = size;
+    return record;
+}
+
+RecordReader::Iterator& RecordReader::Iterator::operator++()
+{
+    current_ = record_.data_ + record_.size_;
+    Read();
+    return *this;
+}
+
+void RecordReader::Iterator::Read()
+{
+    record_ = {};
+    if (current_ == end_)
+        return;
+
+    const uint32_t size = (size_t)(end_ - current_) < RecordStream__HeaderSize ? RecordStream__IndexFlag :
+        RecordStream__Read32(current_);
+    if ((size & RecordStream__IndexFlag) != 0 || (size_t)(end_ - current_) - RecordStream__HeaderSize < size)
+    {
+        // Damaged record ends iteration
+        current_ = end_;
+        return;
+    }
+    record_.data_ = current_ + RecordStream__HeaderSize;
+    record_.size_ = size;
+}
+
+}   // namespace ser
@@ -0,0 +1,162 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace ser
+{
+
+/// Record read from a record stream. Points into memory of the stream, nothing is copied.
+struct RecordView
+{
+    /// First byte of record.
+    const char* data_ = nullptr;
+    /// Size of record in bytes.
+    size_t size_ = 0;
+
+    /// Returns true if view points to a record.
+    explicit operator bool() const { return data_ != nullptr; }
+    /// Returns copy of record.
+    std::string ToString() const { return std::string(data_, size_); }
+};
+
+/// Writes many records, usually output of archive ToString(), into one byte stream. Every record is prefixed by its
+/// length as a 32 bit little endian number. Finish() appends an index of record offsets followed by a trailer that
+/// locates the index, which allows RecordReader to seek to any record in constant time. Streams without index are
+/// valid as well, they are read sequentially.
+class RecordWriter
+{
+public:
+    /// Largest size of a single record.
+    static const size_t MaxRecordSize = 0x7FFFFFFF;
+    /// Returned by Write() when record was not written.
+    static const size_t InvalidIndex = ~(size_t)0;
+
+    /// Append a record. Returns index of the record, or InvalidIndex if record is larger than MaxRecordSize or stream
+    /// is finished already.
+    size_t Write(const void* data, size_t size);
+    /// Append a record. Returns index of the record, or InvalidIndex if record was not written.
+    size_t Write(const std::string& record) { return Write(record.data(), record.size()); }
+    /// Append index of all records written so far and the trailer. Nothing can be written afterwards.
+    void Finish();
+    /// Return bytes written since last call and drop them from the writer, so that long streams can be appended to a
+    /// file as they are written. Record offsets are still counted from the beginning of stream.
+    std::string Flush();
+    /// Forget all records and start a new stream.
+    void Clear();
+
+    /// Returns bytes written since last Flush().
+    const std::string& GetData() const { return data_; }
+    /// Returns number of records written.
+    size_t GetCount() const { return offsets_.size(); }
+    /// Returns true if Finish() was called.
+    bool IsFinished() const { return finished_; }
+
+private:
+    /// Bytes written since last Flush().
+    std::string data_;
+    /// Number of bytes dropped by Flush().
+    uint64_t flushed_ = 0;
+    /// Offset of every record header from the beginning of stream.
+    std::vector<uint64_t> offsets_;
+    /// True if index was written.
+    bool finished_ = false;
+};
+
+/// Reads records from memory written by RecordWriter, typically a mapped file. Memory must outlive the reader and all
+/// views it returns. Records are never copied.
+class RecordReader
+{
+public:
+    /// Iterates records in order by following their length prefixes.
+    class Iterator
+    {
+    public:
+        Iterator() = default;
+        Iterator(const char* current, const char* end) : current_(current), end_(end) { Read(); }
+
+        /// Returns current record.
+        const RecordView& operator*() const { return record_; }
+        /// Returns current record.
+        const RecordView* operator->() const { return &record_; }
+        /// Move to the next record.
+        Iterator& operator++();
+        bool operator==(const Iterator& other) const { return current_ == other.current_; }
+        bool operator!=(const Iterator& other) const { return current_ != other.current_; }
+
+    private:
+        /// Read record at current position, or move to the end if there is none.
+        void Read();
+
+        /// Header of current record.
+        const char* current_ = nullptr;
+        /// End of records.
+        const char* end_ = nullptr;
+        /// Current record.
+        RecordView record_;
+    };
+
+    /// Construct reader of stream in specified memory. Index is used if stream has one, otherwise records are located
+    /// by a single pass over their length prefixes.
+    RecordReader(const void* data, size_t size);
+
+    /// Returns false if stream is truncated or corrupted. Records before the damage are still readable.
+    bool IsValid() const { return valid_; }
+    /// Returns true if stream has an index.
+    bool IsIndexed() const { return index_ != nullptr; }
+    /// Returns number of records.
+    size_t GetCount() const { return count_; }
+    /// Returns record at specified index, or empty view if index is out of range or record is damaged.
+    RecordView Get(size_t index) const;
+    /// Returns record at specified index, or empty view if index is out of range or record is damaged.
+    RecordView operator[](size_t index) const { return Get(index); }
+
+    /// Returns iterator of first record.
+    Iterator begin() const { return Iterator(data_, data_ + recordsSize_); }
+    /// Returns iterator past last record.
+    Iterator end() const { return Iterator(data_ + recordsSize_, data_ + recordsSize_); }
+
+private:
+    /// Read record whose header is at specified offset.
+    RecordView Read(uint64_t offset) const;
+
+    /// Beginning of stream.
+    const char* data_ = nullptr;
+    /// Size of part of stream that holds records, excluding index and trailer.
+    size_t recordsSize_ = 0;
+    /// Offsets of records in stream index, or null if stream has none.
+    const char* index_ = nullptr;
+    /// Offsets of records located by scanning a stream without index.
+    std::vector<uint64_t> offsets_;
+    /// Number of records.
+    size_t count_ = 0;
+    /// False if stream is truncated or corrupted.
+    bool valid_ = true;
+};
+
+}   // namespace ser
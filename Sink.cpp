@@ -0,0 +1,142 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <algorithm>
+#include "Sink.h"
+
+
+namespace ser
+{
+
+// ---------------------- StringSink ----------------------
+
+bool StringSink::Write(const void* data, size_t size)
+{
+    data_.append(static_cast<const char*>(data), size);
+    return true;
+}
+
+std::string StringSink::Take()
+{
+    std::string data;
+    data.swap(data_);
+    return data;
+}
+
+// ---------------------- FileSink ----------------------
+
+bool FileSink::Write(const void* data, size_t size)
+{
+    return std::fwrite(data, 1, size, file_) == size;
+}
+
+bool FileSink::Flush()
+{
+    return std::fflush(file_) == 0;
+}
+
+// ---------------------- AsyncSink ----------------------
+
+AsyncSink::AsyncSink(Sink& target, size_t bufferSize)
+    : target_(target)
+    , bufferSize_(bufferSize > 0 ? bufferSize : 1)
+{
+    front_.reserve(bufferSize_);
+    back_.reserve(bufferSize_);
+    thread_ = std::thread([this]() { Run(); });
+}
+
+AsyncSink::~AsyncSink()
+{
+    Flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    submitted_.notify_one();
+    thread_.join();
+}
+
+bool AsyncSink::Write(const void* data, size_t size)
+{
+    auto* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        const size_t part = std::min(size, bufferSize_ - front_.size());
+        front_.insert(front_.end(), bytes, bytes + part);
+        bytes += part;
+        size -= part;
+        if (front_.size() == bufferSize_)
+            Submit();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !failed_;
+}
+
+bool AsyncSink::Flush()
+{
+    if (!front_.empty())
+        Submit();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    written_.wait(lock, [this]() { return !pending_; });
+    // Background thread is idle, target can be used from this thread
+    const bool flushed = target_.Flush();
+    return flushed && !failed_;
+}
+
+void AsyncSink::Submit()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (pending_)
+    {
+        stalls_++;
+        written_.wait(lock, [this]() { return !pending_; });
+    }
+    front_.swap(back_);
+    pending_ = true;
+    lock.unlock();
+    submitted_.notify_one();
+    front_.clear();
+}
+
+void AsyncSink::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        submitted_.wait(lock, [this]() { return pending_ || stop_; });
+        if (!pending_)
+            break;
+
+        // Caller does not touch back buffer while it is pending
+        lock.unlock();
+        const bool written = target_.Write(back_.data(), back_.size());
+        back_.clear();
+        lock.lock();
+        failed_ = failed_ || !written;
+        pending_ = false;
+        written_.notify_all();
+    }
+}
+
+}   // namespace ser
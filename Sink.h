@@ -0,0 +1,130 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace ser
+{
+
+/// Destination of serialized output. Output archives stream into a sink with Save() instead of building a string.
+class Sink
+{
+public:
+    virtual ~Sink() = default;
+    /// Write specified bytes. Returns false on failure.
+    virtual bool Write(const void* data, size_t size) = 0;
+    /// Make all written bytes reach their destination. Returns false on failure.
+    virtual bool Flush() { return true; }
+};
+
+/// Appends output to a string.
+class StringSink : public Sink
+{
+public:
+    bool Write(const void* data, size_t size) override;
+
+    /// Returns bytes written so far.
+    const std::string& GetData() const { return data_; }
+    /// Return bytes written so far and start over.
+    std::string Take();
+
+private:
+    /// Bytes written so far.
+    std::string data_;
+};
+
+/// Writes output to a stdio file. File is not owned by the sink.
+class FileSink : public Sink
+{
+public:
+    explicit FileSink(std::FILE* file) : file_(file) { }
+
+    bool Write(const void* data, size_t size) override;
+    bool Flush() override;
+
+private:
+    /// Destination file.
+    std::FILE* file_ = nullptr;
+};
+
+/// Double-buffered sink which writes to another sink on a background thread. Caller fills one buffer while the other
+/// is written, so Write() only copies memory unless both buffers are full. Then it waits for background thread, which
+/// limits memory held by pending output. Errors of target sink are reported by subsequent Write() or Flush() calls.
+class AsyncSink : public Sink
+{
+public:
+    /// Construct sink writing to specified target in blocks of specified size. Target must outlive the sink and must
+    /// not be used by anyone else until the sink is destroyed.
+    explicit AsyncSink(Sink& target, size_t bufferSize = 1024 * 1024);
+    AsyncSink(const AsyncSink& other) = delete;
+    AsyncSink& operator=(const AsyncSink& other) = delete;
+    /// Write remaining output and stop background thread.
+    ~AsyncSink() override;
+
+    bool Write(const void* data, size_t size) override;
+    /// Wait until all output is written to target and flush the target.
+    bool Flush() override;
+    /// Returns number of times Write() had to wait for background thread.
+    size_t GetStalls() const { return stalls_; }
+
+private:
+    /// Hand filled buffer to background thread, waiting until the previous one is written.
+    void Submit();
+    /// Background thread loop.
+    void Run();
+
+    /// Sink output is written to.
+    Sink& target_;
+    /// Capacity of each buffer.
+    size_t bufferSize_ = 0;
+    /// Buffer filled by caller.
+    std::vector<char> front_;
+    /// Buffer written by background thread.
+    std::vector<char> back_;
+    /// Protects state shared with background thread.
+    std::mutex mutex_;
+    /// Signaled when back buffer is submitted or thread is stopped.
+    std::condition_variable submitted_;
+    /// Signaled when back buffer is written.
+    std::condition_variable written_;
+    /// True while back buffer waits to be written.
+    bool pending_ = false;
+    /// True when background thread should exit.
+    bool stop_ = false;
+    /// True if target failed to write.
+    bool failed_ = false;
+    /// Number of times Write() waited for background thread.
+    size_t stalls_ = 0;
+    /// Background thread.
+    std::thread thread_;
+};
+
+}   // namespace ser
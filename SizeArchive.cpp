@@ -0,0 +1,298 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <cmath>
+#include <cstring>
+#include "rapidjson/internal/dtoa.h"
+#include "rapidjson/internal/itoa.h"
+#include "SizeArchive.h"
+
+namespace ser
+{
+
+// Size of "null", which new elements hold until a value is written to them.
+static const size_t SizeArchive__NullSize = 4;
+// Number of spaces JSONOutputArchive indents each level with.
+static const size_t SizeArchive__IndentSize = 4;
+
+// Returns size of specified string when quoted and escaped by rapidjson writer.
+static size_t SizeArchive__StringSize(const char* data, size_t length)
+{
+    size_t size = 2 + length;
+    for (size_t i = 0; i < length; i++)
+    {
+        const auto c = (unsigned char)data[i];
+        if (c == '"' || c == '\\' || c == '\b' || c == '\t' || c == '\n' || c == '\f' || c == '\r')
+            size += 1;
+        else if (c < 0x20)
+            size += 5;      // \u00XX
+    }
+    return size;
+}
+
+// ---------------------- SizeArchive::Iterator ----------------------
+
+SizeArchive::Iterator::Iterator(SizeArchive* archive, size_t container, size_t index, bool keyed)
+    : archive_(archive)
+    , container_(container)
+    , index_(index)
+    , keyed_(keyed)
+{
+}
+
+void SizeArchive::Iterator::Copy(ArchiveIterator& destination) const
+{
+    ArchiveIterator::Construct<Iterator>(destination, *this);
+}
+
+int SizeArchive::Iterator::Size() const
+{
+    if (archive_ == nullptr)
+        return 0;
+    return (int)archive_->containers_[container_].count_;
+}
+
+ArchiveIterator SizeArchive::Iterator::operator[](int index)
+{
+    if (archive_ == nullptr || index < 0 || archive_->containers_[container_].map_)
+        return {};
+
+    // Output arrays are padded with nulls up to accessed element
+    auto& container = archive_->containers_[container_];
+    while (container.count_ <= (size_t)index)
+        archive_->AddElement(container, nullptr, 0);
+    return ArchiveIterator::ConstructR<Iterator>(archive_, container_, (size_t)index, false);
+}
+
+void SizeArchive::Iterator::operator++()
+{
+    keyed_ = false;
+    index_++;
+}
+
+ArchiveIterator SizeArchive::Iterator::Find(const std::string& key)
+{
+    if (archive_ == nullptr || !archive_->containers_[container_].map_)
+        return {};
+
+    // Keys are added as soon as they are looked up, same as JSONOutputArchive does
+    auto& container = archive_->containers_[container_];
+    archive_->AddElement(container, key.data(), key.size());
+    return ArchiveIterator::ConstructR<Iterator>(archive_, container_, container.count_ - 1, true);
+}
+
+bool SizeArchive::Iterator::Write(size_t size) const
+{
+    if (archive_ == nullptr)
+        return false;
+
+    auto& container = archive_->containers_[container_];
+    if (!keyed_)
+    {
+        // Map elements exist only when they have a key
+        if (container.map_)
+            return false;
+        while (container.count_ <= index_)
+            archive_->AddElement(container, nullptr, 0);
+    }
+    archive_->size_ = archive_->size_ - SizeArchive__NullSize + size;
+    return !archive_->IsOverLimit();
+}
+
+// ---------------------- SizeArchive ----------------------
+
+SizeArchive::SizeArchive(Format format)
+    : format_(format)
+{
+}
+
+void SizeArchive::Reset(size_t /*highWaterMark*/)
+{
+    size_ = 0;
+    containers_.clear();
+}
+
+void SizeArchive::AddElement(Container& container, const char* key, size_t length)
+{
+    // Records of NDJSON are not separated by commas, but terminated by newlines
+    if (format_ == NDJSON && container.depth_ == 0 && !container.map_)
+    {
+        size_ += SizeArchive__NullSize + 1;
+        container.count_++;
+        return;
+    }
+
+    const bool pretty = format_ == JSON;
+    if (container.count_ == 0)
+    {
+        // Closing bracket of a non-empty container goes on a line of its own
+        if (pretty)
+            size_ += 1 + container.depth_ * SizeArchive__IndentSize;
+    }
+    else
+        size_ += 1;     // ,
+    if (pretty)
+        size_ += 1 + (container.depth_ + 1) * SizeArchive__IndentSize;
+    if (container.map_)
+        size_ += SizeArchive__StringSize(key, length) + (pretty ? 2 : 1);
+    size_ += SizeArchive__NullSize;
+    container.count_++;
+}
+
+ArchiveIterator SizeArchive::Begin(ContainerType type)
+{
+    // Root array of NDJSON has no brackets, any other root is a single record
+    if (format_ == NDJSON)
+        size_ += type == Array ? 0 : 3;
+    else
+        size_ += 2;
+
+    Container container;
+    container.map_ = type == Map;
+    containers_.push_back(container);
+    auto result = ArchiveIterator::ConstructR<Iterator>(this, containers_.size() - 1, (size_t)0, false);
+    TraceContainer(result, "root", 4);
+    return result;
+}
+
+ArchiveIterator SizeArchive::Begin(ArchiveIterator&& it, ContainerType type)
+{
+    if (!it)
+        return {};
+
+    auto* parent = static_cast<Iterator*>(it.Get());   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    if (!parent->Write(2))
+        return {};
+
+    Container container;
+    container.depth_ = containers_[parent->container_].depth_ + 1;
+    container.map_ = type == Map;
+    containers_.push_back(container);
+    auto result = ArchiveIterator::ConstructR<Iterator>(this, containers_.size() - 1, (size_t)0, false);
+    TraceContainer(result, type == Array ? "array" : "map", type == Array ? 5 : 3);
+    return result;
+}
+
+bool SizeArchive::SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& /*cache*/)
+{
+    return Serialize((ArchiveIterator&&)it, typeId, value);
+}
+
+static bool SizeArchive__SerializeInteger(ArchiveIterator& it, int64_t value)
+{
+    if (!it)
+        return false;
+
+    char buffer[21];
+    const char* end = rapidjson::internal::i64toa(value, buffer);
+    return static_cast<SizeArchive::Iterator*>(it.Get())->Write((size_t)(end - buffer));   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+}
+
+static bool SizeArchive__SerializeUnsigned(ArchiveIterator& it, uint64_t value)
+{
+    if (!it)
+        return false;
+
+    char buffer[20];
+    const char* end = rapidjson::internal::u64toa(value, buffer);
+    return static_cast<SizeArchive::Iterator*>(it.Get())->Write((size_t)(end - buffer));   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+}
+
+// Floats are stored as doubles and formatted same as them.
+static bool SizeArchive__SerializeFloat(ArchiveIterator& it, double value)
+{
+    // Writer stops at values JSON can not represent, output would be cut short
+    if (!it || !std::isfinite(value))
+        return false;
+
+    char buffer[25];
+    const char* end = rapidjson::internal::dtoa(value, buffer);
+    return static_cast<SizeArchive::Iterator*>(it.Get())->Write((size_t)(end - buffer));   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, bool& value)
+{
+    if (!it)
+        return false;
+    return static_cast<Iterator*>(it.Get())->Write(value ? 4 : 5);   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, int8_t& value)
+{
+    return SizeArchive__SerializeInteger(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, uint8_t& value)
+{
+    return SizeArchive__SerializeUnsigned(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, int16_t& value)
+{
+    return SizeArchive__SerializeInteger(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, uint16_t& value)
+{
+    return SizeArchive__SerializeUnsigned(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, int32_t& value)
+{
+    return SizeArchive__SerializeInteger(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, uint32_t& value)
+{
+    return SizeArchive__SerializeUnsigned(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, int64_t& value)
+{
+    return SizeArchive__SerializeInteger(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, uint64_t& value)
+{
+    return SizeArchive__SerializeUnsigned(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, float& value)
+{
+    return SizeArchive__SerializeFloat(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, double& value)
+{
+    return SizeArchive__SerializeFloat(it, value);
+}
+
+bool SizeArchive::Serialize(ArchiveIterator&& it, std::string& value)
+{
+    if (!it)
+        return false;
+
+    // JSON archives store strings up to their first null character
+    auto* iterator = static_cast<Iterator*>(it.Get());   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    return iterator->Write(SizeArchive__StringSize(value.c_str(), strlen(value.c_str())));
+}
+
+}   // namespace ser
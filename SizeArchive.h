@@ -0,0 +1,149 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Archive.h"
+
+
+namespace ser
+{
+
+/// Output archive which produces no document, but counts bytes that a JSON archive would produce for same
+/// serialization. Run user's Serialize() through it first to learn exact output size, check it against size limits and
+/// pass it to JSONOutputArchive::ToString(sizeHint) so that output is allocated once. Size is exact when every element
+/// is written once, as serializers normally do. Elements written over again are counted again, therefore size becomes
+/// an upper bound. User types must register serializers of their own with SER_USER_TYPE_SERIALIZER(SizeArchive, ...).
+class SizeArchive : public Archive
+{
+public:
+    /// Output formats whose size can be counted.
+    enum Format
+    {
+        /// Indented JSON, same as JSONOutputArchive::ToString().
+        JSON,
+        /// Compact records terminated by newlines, same as NDJSONOutputArchive::ToString().
+        NDJSON,
+    };
+
+    /// Position within a container. Begin() returns an iterator at first element of new container, operator[] and
+    /// Find() return iterators at specified element.
+    class Iterator : public detail::IArchiveIterator
+    {
+    protected:
+        void Copy(ArchiveIterator& destination) const override;
+        ArchiveIterator operator[](int index) override;
+        void operator++() override;
+
+    public:
+        Iterator(SizeArchive* archive, size_t container, size_t index, bool keyed);
+        Iterator(const Iterator& other) = default;
+
+        /// Returns number of elements counted in array this iterator points into.
+        int Size() const override;
+        ArchiveIterator Find(const std::string& key) override;
+        /// Output containers can always be appended.
+        bool AtEnd() const override { return archive_ == nullptr; }
+
+        /// Count value of specified size at this position, in place of null it replaces. Returns false if position is
+        /// not in an array or a map, or if size limit was exceeded.
+        bool Write(size_t size) const;
+
+    protected:
+        friend class SizeArchive;
+
+        SizeArchive* archive_ = nullptr;
+        /// Index of container this iterator points into.
+        size_t container_ = 0;
+        /// Index of current element.
+        size_t index_ = 0;
+        /// True if current element was added by Find() already.
+        bool keyed_ = false;
+    };
+    static_assert(sizeof(Iterator) <= ArchiveIterator::StorageSize, "ArchiveIterator::storage_ is too small.");
+private:
+    SER_USER_CONTAINER(SizeArchive);
+public:
+    /// Construct archive which counts size of specified format.
+    explicit SizeArchive(Format format = JSON);
+
+    /// Start counting anew, with the same format and limit.
+    void Reset(size_t highWaterMark = 0) override;
+    /// Returns number of bytes output would take.
+    size_t GetSize() const { return size_; }
+    /// Make serialization fail as soon as output grows past specified number of bytes, 0 for no limit. Serializers
+    /// which check results stop early, without visiting rest of their values.
+    void SetLimit(size_t limit) { limit_ = limit; }
+    /// Returns true if output grew past the limit.
+    bool IsOverLimit() const { return limit_ > 0 && size_ > limit_; }
+
+    /// Begin root container of specified type.
+    ArchiveIterator Begin(ContainerType type) override;
+    /// Begin container of specified type at specified position.
+    ArchiveIterator Begin(ArchiveIterator&& it, ContainerType type) override;
+
+    using Archive::SerializeCached;
+    /// Serialize user type. Counting does not modify value, therefore cache is left intact.
+    bool SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& cache) override;
+
+    bool Serialize(ArchiveIterator&& it, bool& value) override;
+    bool Serialize(ArchiveIterator&& it, int8_t& value) override;
+    bool Serialize(ArchiveIterator&& it, uint8_t& value) override;
+    bool Serialize(ArchiveIterator&& it, int16_t& value) override;
+    bool Serialize(ArchiveIterator&& it, uint16_t& value) override;
+    bool Serialize(ArchiveIterator&& it, int32_t& value) override;
+    bool Serialize(ArchiveIterator&& it, uint32_t& value) override;
+    bool Serialize(ArchiveIterator&& it, int64_t& value) override;
+    bool Serialize(ArchiveIterator&& it, uint64_t& value) override;
+    bool Serialize(ArchiveIterator&& it, float& value) override;
+    bool Serialize(ArchiveIterator&& it, double& value) override;
+    bool Serialize(ArchiveIterator&& it, std::string& value) override;
+
+protected:
+    /// Container whose elements are counted.
+    struct Container
+    {
+        /// Nesting depth, root container has depth 0.
+        unsigned depth_ = 0;
+        /// True if elements have keys.
+        bool map_ = false;
+        /// Number of elements counted.
+        size_t count_ = 0;
+    };
+
+    /// Count a new null element of specified container, preceded by separators, indentation and specified key.
+    void AddElement(Container& container, const char* key, size_t length);
+
+    /// Format size is counted for.
+    Format format_ = JSON;
+    /// Number of bytes counted.
+    size_t size_ = 0;
+    /// Number of bytes serialization may not exceed, 0 for no limit.
+    size_t limit_ = 0;
+    /// Containers begun since last Reset(), indexed by iterators.
+    std::vector<Container> containers_;
+};
+
+}   // namespace ser
@@ -0,0 +1,254 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "Tracer.h"
+
+namespace ser
+{
+
+// ---------------------- Ring buffers ----------------------
+
+// Event is stored in relaxed atomic words, so that events can be read while their thread overwrites old ones. Reader
+// discards events which could have been overwritten while it was copying them.
+static const size_t Tracer__NameWords = 4;
+
+struct Tracer__Event
+{
+    std::atomic<uint64_t> timestamp_;
+    std::atomic<uint64_t> category_;
+    // Phase in lowest byte, name length above it.
+    std::atomic<uint64_t> phase_;
+    std::atomic<uint64_t> name_[Tracer__NameWords];
+};
+
+// Events of a single thread. Only owning thread writes events.
+struct Tracer__Buffer
+{
+    explicit Tracer__Buffer(size_t capacity, unsigned threadId)
+        : events_(new Tracer__Event[capacity])
+        , capacity_(capacity)
+        , threadId_(threadId)
+    {
+    }
+
+    std::unique_ptr<Tracer__Event[]> events_;
+    size_t capacity_;
+    unsigned threadId_;
+    // Number of events ever written.
+    std::atomic<uint64_t> head_{0};
+    // Events written before this position were cleared.
+    std::atomic<uint64_t> cleared_{0};
+};
+
+// Buffers of all threads. Buffers of exited threads are kept until Clear(), so that their events are not lost.
+struct Tracer__Registry
+{
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Tracer__Buffer>> buffers_;
+    std::atomic<size_t> capacity_{64 * 1024};
+    unsigned nextThreadId_ = 1;
+};
+
+static Tracer__Registry& Tracer__GetRegistry()
+{
+    static Tracer__Registry registry;
+    return registry;
+}
+
+static Tracer__Buffer& Tracer__GetBuffer()
+{
+    static thread_local std::shared_ptr<Tracer__Buffer> buffer;
+    if (!buffer)
+    {
+        auto& registry = Tracer__GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex_);
+        buffer = std::make_shared<Tracer__Buffer>(registry.capacity_.load(std::memory_order_relaxed), registry.nextThreadId_++);
+        registry.buffers_.push_back(buffer);
+    }
+    return *buffer;
+}
+
+static uint64_t Tracer__Now()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+static void Tracer__Record(char phase, const char* category, const char* name, size_t length)
+{
+    auto& buffer = Tracer__GetBuffer();
+    auto head = buffer.head_.load(std::memory_order_relaxed);
+    auto& event = buffer.events_[head % buffer.capacity_];
+
+    uint64_t words[Tracer__NameWords]{};
+    length = std::min(length, sizeof(words));
+    if (length > 0)
+        memcpy(words, name, length);
+
+    event.timestamp_.store(Tracer__Now(), std::memory_order_relaxed);
+    event.category_.store(reinterpret_cast<uintptr_t>(category), std::memory_order_relaxed);
+    event.phase_.store((uint64_t)(unsigned char)phase | (uint64_t)length << 8u, std::memory_order_relaxed);
+    for (size_t i = 0; i < Tracer__NameWords; i++)
+        event.name_[i].store(words[i], std::memory_order_relaxed);
+
+    // Publish event
+    buffer.head_.store(head + 1, std::memory_order_release);
+}
+
+void detail::TraceBegin(const char* category, const char* name, size_t length)
+{
+    Tracer__Record('B', category, name, length);
+}
+
+void detail::TraceEnd(const char* category)
+{
+    Tracer__Record('E', category, nullptr, 0);
+}
+
+// ---------------------- Tracer ----------------------
+
+std::atomic<bool> Tracer::enabled_{false};
+
+void Tracer::Start(size_t eventsPerThread)
+{
+    Tracer__GetRegistry().capacity_.store(std::max<size_t>(eventsPerThread, 16), std::memory_order_relaxed);
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::Stop()
+{
+    enabled_.store(false, std::memory_order_relaxed);
+}
+
+void Tracer::Clear()
+{
+    auto& registry = Tracer__GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex_);
+
+    // Buffers referenced only by registry belong to threads that exited
+    registry.buffers_.erase(std::remove_if(registry.buffers_.begin(), registry.buffers_.end(),
+        [](const std::shared_ptr<Tracer__Buffer>& buffer) { return buffer.use_count() == 1; }), registry.buffers_.end());
+
+    for (auto& buffer : registry.buffers_)
+        buffer->cleared_.store(buffer->head_.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+std::string Tracer::ToJSON()
+{
+    rapidjson::StringBuffer output;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(output);
+    writer.StartObject();
+    writer.Key("traceEvents");
+    writer.StartArray();
+
+    auto& registry = Tracer__GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex_);
+    for (auto& buffer : registry.buffers_)
+    {
+        const uint64_t head = buffer->head_.load(std::memory_order_acquire);
+        const uint64_t capacity = buffer->capacity_;
+        uint64_t first = head > capacity ? head - capacity : 0;
+        first = std::max(first, buffer->cleared_.load(std::memory_order_relaxed));
+
+        struct Event
+        {
+            uint64_t timestamp_;
+            const char* category_;
+            uint64_t phase_;
+            uint64_t name_[Tracer__NameWords];
+        };
+        std::vector<Event> events;
+        events.reserve(head - first);
+        for (uint64_t i = first; i < head; i++)
+        {
+            const auto& source = buffer->events_[i % capacity];
+            Event event{};
+            event.timestamp_ = source.timestamp_.load(std::memory_order_relaxed);
+            event.category_ = reinterpret_cast<const char*>(source.category_.load(std::memory_order_relaxed));
+            event.phase_ = source.phase_.load(std::memory_order_relaxed);
+            for (size_t j = 0; j < Tracer__NameWords; j++)
+                event.name_[j] = source.name_[j].load(std::memory_order_relaxed);
+            events.push_back(event);
+        }
+
+        // Drop events that thread may have overwritten while they were being copied
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t headAfter = buffer->head_.load(std::memory_order_relaxed);
+        const uint64_t valid = headAfter > capacity ? headAfter - capacity : 0;
+        size_t skip = valid > first ? (size_t)std::min<uint64_t>(valid - first, events.size()) : 0;
+
+        // Ends of spans whose beginnings were overwritten confuse trace viewers
+        size_t depth = 0;
+        for (size_t i = skip; i < events.size(); i++)
+        {
+            const auto& event = events[i];
+            const char phase = (char)(event.phase_ & 0xFFu);
+            if (phase == 'B')
+                depth++;
+            else if (depth == 0)
+                continue;
+            else
+                depth--;
+
+            writer.StartObject();
+            if (phase == 'B')
+            {
+                writer.Key("name");
+                writer.String(reinterpret_cast<const char*>(event.name_), (rapidjson::SizeType)(event.phase_ >> 8u));
+            }
+            writer.Key("cat");
+            writer.String(event.category_);
+            writer.Key("ph");
+            writer.String(&phase, 1);
+            writer.Key("ts");
+            writer.Double((double)event.timestamp_ / 1000.0);
+            writer.Key("pid");
+            writer.Uint(1);
+            writer.Key("tid");
+            writer.Uint(buffer->threadId_);
+            writer.EndObject();
+        }
+    }
+
+    writer.EndArray();
+    writer.Key("displayTimeUnit");
+    writer.String("ns");
+    writer.EndObject();
+    return {output.GetString(), output.GetSize()};
+}
+
+bool Tracer::Save(const std::string& path)
+{
+    std::ofstream file(path);
+    file << ToJSON();
+    return (bool)file;
+}
+
+}   // namespace ser
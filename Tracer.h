@@ -0,0 +1,99 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+
+namespace ser
+{
+
+/// Records spans of containers, user type serializers, ToString() and parsing in Chrome trace event format. Events are
+/// kept in a fixed size ring buffer of each thread, so only most recent events survive long recordings. Load result of
+/// ToJSON() in chrome://tracing or any other trace viewer.
+class Tracer
+{
+public:
+    /// Start recording events on all threads. Ring buffers of threads that record their first event from now on hold
+    /// specified amount of events.
+    static void Start(size_t eventsPerThread = 64 * 1024);
+    /// Stop recording events. Spans that are in progress still record their ends.
+    static void Stop();
+    /// Returns true if events are being recorded.
+    static bool IsEnabled() { return enabled_.load(std::memory_order_relaxed); }
+    /// Discard recorded events of all threads.
+    static void Clear();
+    /// Returns recorded events of all threads as a Chrome trace event JSON document.
+    static std::string ToJSON();
+    /// Write ToJSON() to specified file. Returns false on failure.
+    static bool Save(const std::string& path);
+
+private:
+    /// Flag checked by every span, therefore a disabled tracer costs a single load.
+    static std::atomic<bool> enabled_;
+};
+
+namespace detail
+{
+
+/// Record beginning of a span on calling thread. Name is truncated to a few dozen characters.
+void TraceBegin(const char* category, const char* name, size_t length);
+/// Record end of span on calling thread.
+void TraceEnd(const char* category);
+
+/// Records a span for the lifetime of this object, if tracer is enabled when object is constructed.
+class TraceScope
+{
+public:
+    TraceScope(const char* category, const char* name, size_t length)
+        : category_(Tracer::IsEnabled() ? category : nullptr)
+    {
+        if (category_ != nullptr)
+            TraceBegin(category_, name, length);
+    }
+    /// Record a span with specified null-terminated name. Span is not recorded if name is null.
+    TraceScope(const char* category, const char* name)
+        : category_(name != nullptr && Tracer::IsEnabled() ? category : nullptr)
+    {
+        if (category_ != nullptr)
+            TraceBegin(category_, name, strlen(name));
+    }
+    TraceScope(const TraceScope& other) = delete;
+    TraceScope& operator=(const TraceScope& other) = delete;
+    ~TraceScope()
+    {
+        if (category_ != nullptr)
+            TraceEnd(category_);
+    }
+
+private:
+    /// Category of recorded span or null if span is not recorded.
+    const char* category_;
+};
+
+}   // namespace detail
+
+}   // namespace ser
@@ -19,17 +19,261 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 // DEALINGS IN THE SOFTWARE.
 //
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rapidjson/internal/dtoa.h"
+#include "rapidjson/internal/itoa.h"
+#include "rapidjson/reader.h"
+#include "Memory.h"
+#include "Parallel.h"
+#include "Path.h"
+#include "Profiler.h"
+#include "Tracer.h"
 #include "XMLArchive.h"
 
 
 namespace ser
 {
 
+// ---------------------- Value conversion ----------------------
+
+// Numbers are converted to and from text without touching the heap. Formatting produces shortest representation that
+// parses back to the same value. Parsing reuses rapidjson number reader, which does not throw and is exact.
+
+static const char* XMLArchive__FormatValue(bool value, char* /*buffer*/)
+{
+    return value ? "true" : "false";
+}
+
+template<typename T>
+static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, const char*>::type
+XMLArchive__FormatValue(T value, char* buffer)
+{
+    *rapidjson::internal::i64toa(value, buffer) = 0;
+    return buffer;
+}
+
+template<typename T>
+static typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, const char*>::type
+XMLArchive__FormatValue(T value, char* buffer)
+{
+    *rapidjson::internal::u64toa(value, buffer) = 0;
+    return buffer;
+}
+
+static const char* XMLArchive__FormatValue(double value, char* buffer)
+{
+    rapidjson::internal::Double d(value);
+    if (d.IsNan())
+        return "NaN";
+    if (d.IsInf())
+        return d.Sign() ? "-Infinity" : "Infinity";
+
+    *rapidjson::internal::dtoa(value, buffer) = 0;
+    return buffer;
+}
+
+static const char* XMLArchive__FormatValue(float value, char* buffer)
+{
+    using namespace rapidjson::internal;
+
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t f = bits & 0x7FFFFFu;
+    int e = (int)((bits >> 23u) & 0xFFu);
+
+    if (e == 0xFF)
+        return f != 0 ? "NaN" : (bits >> 31u) ? "-Infinity" : "Infinity";
+
+    char* end = buffer;
+    if (bits >> 31u)
+        *end++ = '-';
+
+    if (f == 0 && e == 0)
+    {
+        memcpy(end, "0.0", 4);
+        return buffer;
+    }
+
+    if (e != 0)
+    {
+        f |= 0x800000u;
+        e -= 150;
+    }
+    else
+        e = -149;
+
+    // Same as Grisu2() in rapidjson/internal/dtoa.h, except that boundaries are those of a single precision value.
+    // Double precision formatting of a float would print digits that are not needed to restore it.
+    const DiyFp v(f, e);
+    DiyFp w_p = DiyFp((f << 1u) + 1, e - 1).NormalizeBoundary();
+    DiyFp w_m = f == 0x800000u ? DiyFp((f << 2u) - 1, e - 2) : DiyFp((f << 1u) - 1, e - 1);
+    w_m.f <<= (unsigned)(w_m.e - w_p.e);
+    w_m.e = w_p.e;
+
+    int length = 0;
+    int K = 0;
+    const DiyFp c_mk = GetCachedPower(w_p.e, &K);
+    const DiyFp W = v.Normalize() * c_mk;
+    DiyFp Wp = w_p * c_mk;
+    DiyFp Wm = w_m * c_mk;
+    Wm.f++;
+    Wp.f--;
+    DigitGen(W, Wp, Wp.f - Wm.f, end, &length, &K);
+    *Prettify(end, length, K, 324) = 0;
+    return buffer;
+}
+
+// Receives a single number from rapidjson::Reader.
+struct XMLArchive__Number : rapidjson::BaseReaderHandler<rapidjson::UTF8<>, XMLArchive__Number>
+{
+    enum { None, Signed, Unsigned, Floating } type_ = None;
+    int64_t signed_ = 0;
+    uint64_t unsigned_ = 0;
+    double floating_ = 0;
+
+    bool Default() { return false; }
+    bool Int(int value) { type_ = Signed; signed_ = value; return true; }
+    bool Int64(int64_t value) { type_ = Signed; signed_ = value; return true; }
+    bool Uint(unsigned value) { type_ = Unsigned; unsigned_ = value; return true; }
+    bool Uint64(uint64_t value) { type_ = Unsigned; unsigned_ = value; return true; }
+    bool Double(double value) { type_ = Floating; floating_ = value; return true; }
+};
+
+static bool XMLArchive__IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool XMLArchive__ParseNumber(const char* text, XMLArchive__Number& number)
+{
+    // Number grammar follows std::stoll() and std::stod(), which were used before: leading whitespace, plus sign,
+    // leading zeros and fractions without digits on one side of the point are accepted. JSON grammar rejects them,
+    // therefore text is normalized before it is passed to the reader. Unlike std::stoll(), trailing text is an error
+    // and integers can not be read from numbers with a fraction or exponent.
+    while (*text == ' ' || *text == '\t' || *text == '\n' || *text == '\r')
+        text++;
+    const bool minus = *text == '-';
+    if (*text == '-' || *text == '+')
+        text++;
+    if (*text == '-' || *text == '+')
+        return false;
+    while (text[0] == '0' && XMLArchive__IsDigit(text[1]))
+        text++;
+
+    // Normalized text of sensible numbers fits on the stack, longer numbers spill to heap
+    const size_t length = strlen(text);
+    char small[64];
+    std::string large;
+    if (length + 3 > sizeof(small))
+        large.resize(length + 3);
+    char* normalized = large.empty() ? small : &large[0];
+    char* end = normalized;
+    if (minus)
+        *end++ = '-';
+    if (text[0] == '.' && XMLArchive__IsDigit(text[1]))
+        *end++ = '0';
+    for (const char* c = text; *c != 0; c++)
+    {
+        if (*c == '.' && c > text && XMLArchive__IsDigit(c[-1]) && !XMLArchive__IsDigit(c[1]))
+            continue;
+        *end++ = *c;
+    }
+    *end = 0;
+
+    // Reader buffers digits of numbers that need full precision conversion. Small buffer on the stack is enough for
+    // any sensible input, longer numbers spill to heap.
+    char buffer[512];
+    rapidjson::MemoryPoolAllocator<> allocator(buffer, sizeof(buffer));
+    rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>> reader(&allocator, 256);
+    rapidjson::StringStream stream(normalized);
+
+    const unsigned flags = rapidjson::kParseFullPrecisionFlag | rapidjson::kParseNanAndInfFlag | rapidjson::kParseStopWhenDoneFlag;
+    if (reader.Parse<flags>(stream, number).IsError())
+        return false;
+
+    rapidjson::SkipWhitespace(stream);
+    return stream.Peek() == 0;
+}
+
+static bool XMLArchive__ParseValue(const char* text, bool& value)
+{
+    if (strcmp(text, "true") == 0 || strcmp(text, "1") == 0)
+        value = true;
+    else if (strcmp(text, "false") == 0 || strcmp(text, "0") == 0)
+        value = false;
+    else
+        return false;
+    return true;
+}
+
+template<typename T>
+static typename std::enable_if<std::is_integral<T>::value, bool>::type
+XMLArchive__ParseValue(const char* text, T& value)
+{
+    XMLArchive__Number number;
+    if (!XMLArchive__ParseNumber(text, number))
+        return false;
+
+    if (number.type_ == XMLArchive__Number::Signed)
+    {
+        if (number.signed_ < 0)
+        {
+            if (std::is_unsigned<T>::value || number.signed_ < (int64_t)std::numeric_limits<T>::min())
+                return false;
+        }
+        else if ((uint64_t)number.signed_ > (uint64_t)std::numeric_limits<T>::max())
+            return false;
+
+        value = (T)number.signed_;
+        return true;
+    }
+    else if (number.type_ == XMLArchive__Number::Unsigned)
+    {
+        if (number.unsigned_ > (uint64_t)std::numeric_limits<T>::max())
+            return false;
+
+        value = (T)number.unsigned_;
+        return true;
+    }
+    return false;
+}
+
+template<typename T>
+static typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+XMLArchive__ParseValue(const char* text, T& value)
+{
+    XMLArchive__Number number;
+    if (!XMLArchive__ParseNumber(text, number))
+        return false;
+
+    if (number.type_ == XMLArchive__Number::Signed)
+        value = (T)number.signed_;
+    else if (number.type_ == XMLArchive__Number::Unsigned)
+        value = (T)number.unsigned_;
+    else
+    {
+        // Finite values out of range of float fail instead of becoming infinite, same as std::stof()
+        const T converted = (T)number.floating_;
+        if (std::isinf(converted) && std::isfinite(number.floating_))
+            return false;
+        value = converted;
+    }
+    return true;
+}
+
 // ---------------------- XMLArchive::InputIterator ----------------------
 
 ArchiveIterator XMLArchive::InputIterator::Construct(pugi::xml_node container, pugi::xml_node index)
 {
-    return ArchiveIterator::ConstructR<InputIterator>(container, index);
+    return ArchiveIterator::ConstructR<InputIterator>(archive_, container, index);
 }
 
 void XMLArchive::InputIterator::Copy(ArchiveIterator& destination) const
@@ -37,14 +281,16 @@ void XMLArchive::InputIterator::Copy(ArchiveIterator& destination) const
     ArchiveIterator::Construct<InputIterator>(destination, *this);
 }
 
-XMLArchive::InputIterator::InputIterator(pugi::xml_node container)
-    : container_(container)
+XMLArchive::InputIterator::InputIterator(XMLArchive* archive, pugi::xml_node container)
+    : archive_(archive)
+    , container_(container)
     , index_(container.first_child())
 {
 }
 
-XMLArchive::InputIterator::InputIterator(pugi::xml_node container, pugi::xml_node index)
-    : container_(container)
+XMLArchive::InputIterator::InputIterator(XMLArchive* archive, pugi::xml_node container, pugi::xml_node index)
+    : archive_(archive)
+    , container_(container)
     , index_(index)
 {
 }
@@ -62,7 +308,7 @@ int XMLArchive::InputIterator::Size() const
     if (container_.empty())
         return 0;
 
-    return std::distance(container_.begin(), container_.end());
+    return archive_->GetSize(container_);
 }
 
 ArchiveIterator XMLArchive::InputIterator::Find(const std::string& key)
@@ -70,9 +316,13 @@ ArchiveIterator XMLArchive::InputIterator::Find(const std::string& key)
     if (container_.empty())
         return ArchiveIterator{};
 
-    auto node = container_.find_child_by_attribute("value", "key", key.c_str());
+    detail::CountMetric(detail::XMLMetrics, detail::FindCounter);
+    auto node = archive_->FindChild(container_, key.c_str());
     if (node.empty())
+    {
+        detail::CountMetric(detail::XMLMetrics, detail::FindMissCounter);
         return {};
+    }
 
     return Construct(container_, node);
 }
@@ -84,13 +334,10 @@ bool XMLArchive::InputIterator::AtEnd() const
 
 ArchiveIterator XMLArchive::InputIterator::operator[](int index)
 {
-    if (container_.empty() || Size() <= index)
+    if (container_.empty() || index < 0 || Size() <= index)
         return {};
 
-    auto it = container_.begin();
-    for (; index-- > 0; it++);
-
-    return Construct(container_, *it);
+    return Construct(container_, archive_->GetChild(container_, index));
 }
 
 void XMLArchive::InputIterator::operator++()
@@ -98,11 +345,652 @@ void XMLArchive::InputIterator::operator++()
     index_ = index_.next_sibling();
 }
 
+// ---------------------- XMLArchive ----------------------
+
+// pugixml allocates document memory in pages of equal size. Pages freed by documents are kept in a per-thread pool and
+// handed out again to documents of the same thread, so that documents which are reset or constructed repeatedly do not
+// go to the heap. While a MemoryResourceScope is active, memory comes from its resource instead. Archives make their own
+// resource current whenever they allocate, so that a document never mixes memory of different resources. Functions
+// are process-wide and are installed during static initialization of this file. Memory which pugixml allocated before
+// that, from static initializers of other files, can not be told apart from blocks of Allocate() and must be freed
+// before functions are installed.
+
+#ifdef PUGIXML_MEMORY_PAGE_SIZE
+static const size_t XMLArchive__PageSize = PUGIXML_MEMORY_PAGE_SIZE;
+#else
+static const size_t XMLArchive__PageSize = 32768;
+#endif
+static const size_t XMLArchive__PagePoolLimit = 16 * 1024 * 1024;
+
+// Pooled page, link is stored in memory of the page itself.
+struct XMLArchive__FreePage
+{
+    XMLArchive__FreePage* next_;
+};
+
+// Trivially destructible so that it stays usable while thread-local and static objects are destroyed.
+struct XMLArchive__PagePool
+{
+    XMLArchive__FreePage* free_;
+    size_t size_;
+    bool disabled_;
+};
+static thread_local XMLArchive__PagePool XMLArchive__pagePool{};
+
+// Frees pooled pages when thread exits.
+struct XMLArchive__PagePoolCleanup
+{
+    ~XMLArchive__PagePoolCleanup()
+    {
+        XMLArchive::TrimPagePool(0);
+        XMLArchive__pagePool.disabled_ = true;
+    }
+};
+
+static void* XMLArchive__Allocate(size_t size)
+{
+    auto* resource = MemoryResourceScope::Current();
+    auto& pool = XMLArchive__pagePool;
+    if (resource == nullptr && size == XMLArchive__PageSize && pool.free_ != nullptr)
+    {
+        auto* page = pool.free_;
+        pool.free_ = page->next_;
+        pool.size_ -= XMLArchive__PageSize;
+        detail::SetBlockStats(page, detail::MemoryStatsScope::Current());
+        return page;
+    }
+    return detail::Allocate(resource, size, detail::MemoryStatsScope::Current());
+}
+
+static void XMLArchive__Deallocate(void* ptr)
+{
+    if (ptr == nullptr)
+        return;
+
+    auto& pool = XMLArchive__pagePool;
+    if (detail::GetBlockResource(ptr) == nullptr && detail::GetBlockSize(ptr) == XMLArchive__PageSize &&
+        !pool.disabled_ && pool.size_ < XMLArchive__PagePoolLimit)
+    {
+        static thread_local XMLArchive__PagePoolCleanup cleanup;
+        (void)cleanup;
+
+        // Pooled pages do not belong to any archive
+        detail::SetBlockStats(ptr, nullptr);
+
+        auto* page = static_cast<XMLArchive__FreePage*>(ptr);
+        page->next_ = pool.free_;
+        pool.free_ = page;
+        pool.size_ += XMLArchive__PageSize;
+    }
+    else
+        detail::Deallocate(ptr);
+}
+
+// Installs memory functions once. Archives constructed by static initializers of other files may run before static
+// initialization of this file, therefore they install functions too.
+static void XMLArchive__InstallMemoryFunctions()
+{
+    static const bool installed = (pugi::set_memory_management_functions(&XMLArchive__Allocate,
+        &XMLArchive__Deallocate), true);
+    (void)installed;
+}
+
+// Functions are installed before main(), so that documents which the application creates with pugixml directly use
+// them from the start.
+static const bool XMLArchive__memoryFunctionsInstalled = (XMLArchive__InstallMemoryFunctions(), true);
+
+XMLArchive::XMLArchive(MemoryResource* resource)
+    : resource_(resource)
+{
+    XMLArchive__InstallMemoryFunctions();
+}
+
+void XMLArchive::TrimPagePool(size_t bytes)
+{
+    auto& pool = XMLArchive__pagePool;
+    while (pool.free_ != nullptr && pool.size_ > bytes)
+    {
+        auto* page = pool.free_;
+        pool.free_ = page->next_;
+        pool.size_ -= XMLArchive__PageSize;
+        detail::Deallocate(page);
+    }
+}
+
+void XMLArchive::Reset(size_t highWaterMark)
+{
+    index_.clear();
+    root_.reset();
+
+    if (highWaterMark > 0)
+        TrimPagePool(highWaterMark);
+}
+
+// Returns true if node holds child values rather than text.
+static bool XMLArchive__IsContainer(pugi::xml_node node)
+{
+    return node.first_child().type() == pugi::node_element;
+}
+
+// Returns true if nodes have equal names and attributes other than their keys. User type serializers may rename nodes
+// and add attributes of their own.
+static bool XMLArchive__SameTag(pugi::xml_node a, pugi::xml_node b)
+{
+    if (strcmp(a.name(), b.name()) != 0)
+        return false;
+
+    auto attributeA = a.first_attribute();
+    auto attributeB = b.first_attribute();
+    for (;; attributeA = attributeA.next_attribute(), attributeB = attributeB.next_attribute())
+    {
+        if (attributeA && strcmp(attributeA.name(), "key") == 0)
+            attributeA = attributeA.next_attribute();
+        if (attributeB && strcmp(attributeB.name(), "key") == 0)
+            attributeB = attributeB.next_attribute();
+        if (!attributeA || !attributeB)
+            return !attributeA && !attributeB;
+        if (strcmp(attributeA.name(), attributeB.name()) != 0 || strcmp(attributeA.value(), attributeB.value()) != 0)
+            return false;
+    }
+}
+
+// Containers with fewer children are searched linearly, lookup structures are built only for larger ones.
+static const size_t XMLArchive__IndexThreshold = 16;
+
+static unsigned XMLArchive__KeyHash(const char* key)
+{
+    unsigned hash = 0;
+    for (; *key != 0; key++)
+        hash = detail::SDBMHash(hash, (unsigned char)*key);
+    return hash;
+}
+
+// Matches children of a container by key, regardless of element name. Children of compared containers are usually in
+// the same order, therefore child following the previous match is tried first. Keys of large containers are hashed on
+// first miss, so that comparing two containers takes linear time instead of searching one for every child of the other.
+class XMLArchive__ChildMatcher
+{
+public:
+    explicit XMLArchive__ChildMatcher(pugi::xml_node container)
+        : container_(container), cursor_(container.first_child())
+    {
+    }
+
+    pugi::xml_node Find(const char* key)
+    {
+        if (cursor_ && strcmp(cursor_.attribute("key").value(), key) == 0)
+            return Match(cursor_);
+
+        if (!indexed_)
+        {
+            indexed_ = true;
+            size_t count = 0;
+            for (auto child = container_.first_child(); child && count < XMLArchive__IndexThreshold;
+                child = child.next_sibling())
+                count++;
+
+            // Inserted in reverse, so that first child with a given key is found first
+            if (count >= XMLArchive__IndexThreshold)
+            {
+                for (auto child = container_.last_child(); child; child = child.previous_sibling())
+                {
+                    auto attribute = child.attribute("key");
+                    if (!attribute.empty())
+                        keys_.emplace(XMLArchive__KeyHash(attribute.value()), child);
+                }
+            }
+        }
+
+        if (keys_.empty())
+            return Match(container_.find_child_by_attribute("key", key));
+
+        auto range = keys_.equal_range(XMLArchive__KeyHash(key));
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (strcmp(it->second.attribute("key").value(), key) == 0)
+                return Match(it->second);
+        }
+        return {};
+    }
+
+private:
+    pugi::xml_node Match(pugi::xml_node child)
+    {
+        if (child)
+            cursor_ = child.next_sibling();
+        return child;
+    }
+
+    pugi::xml_node container_;
+    pugi::xml_node cursor_;
+    bool indexed_ = false;
+    std::unordered_multimap<unsigned, pugi::xml_node> keys_;
+};
+
+// Collects values of current document that differ from baseline into a delta document.
+struct XMLArchive__DeltaWriter
+{
+    pugi::xml_node delta_;
+    /// Path of values being compared.
+    std::string path_;
+
+    void Set(pugi::xml_node value)
+    {
+        auto set = delta_.append_child("set");
+        set.append_attribute("path").set_value(path_.c_str());
+        // Copy carries name and attributes of value, key is a part of path already
+        set.append_copy(value).remove_attribute("key");
+    }
+
+    void Remove()
+    {
+        delta_.append_child("remove").append_attribute("path").set_value(path_.c_str());
+    }
+
+    void Diff(pugi::xml_node baseline, pugi::xml_node current)
+    {
+        if (!XMLArchive__SameTag(baseline, current))
+        {
+            Set(current);
+            return;
+        }
+
+        const bool container = XMLArchive__IsContainer(current);
+        const bool keyed = !current.first_child().attribute("key").empty();
+        if (!container && !XMLArchive__IsContainer(baseline))
+        {
+            if (strcmp(baseline.child_value(), current.child_value()) != 0)
+                Set(current);
+            return;
+        }
+        if (container != XMLArchive__IsContainer(baseline) || keyed != !baseline.first_child().attribute("key").empty())
+        {
+            Set(current);
+            return;
+        }
+
+        const size_t length = path_.size();
+        if (keyed)
+        {
+            XMLArchive__ChildMatcher baselineChildren(baseline);
+            for (auto child : current.children())
+            {
+                const char* key = child.attribute("key").value();
+                detail::AppendPathToken(path_, key, strlen(key));
+                if (auto previous = baselineChildren.Find(key))
+                    Diff(previous, child);
+                else
+                    Set(child);
+                path_.resize(length);
+            }
+
+            XMLArchive__ChildMatcher currentChildren(current);
+            for (auto child : baseline.children())
+            {
+                const char* key = child.attribute("key").value();
+                if (currentChildren.Find(key))
+                    continue;
+                detail::AppendPathToken(path_, key, strlen(key));
+                Remove();
+                path_.resize(length);
+            }
+            return;
+        }
+
+        // Elements past the end of baseline are appended, surplus elements of baseline are removed from the back
+        auto previous = baseline.first_child();
+        size_t index = 0;
+        for (auto child : current.children())
+        {
+            const std::string token = std::to_string(index++);
+            detail::AppendPathToken(path_, token.c_str(), token.size());
+            if (previous)
+            {
+                Diff(previous, child);
+                previous = previous.next_sibling();
+            }
+            else
+                Set(child);
+            path_.resize(length);
+        }
+
+        size_t surplus = index;
+        for (; previous; previous = previous.next_sibling())
+            surplus++;
+        while (surplus > index)
+        {
+            const std::string token = std::to_string(--surplus);
+            detail::AppendPathToken(path_, token.c_str(), token.size());
+            Remove();
+            path_.resize(length);
+        }
+    }
+};
+
+void XMLArchive::MakeDelta(const XMLArchive& baseline, XMLArchive& delta) const
+{
+    delta.Reset();
+    MemoryScope memoryScope(&delta);
+    auto root = delta.root_.first_child();
+    if (!root)
+        root = delta.root_.append_child("root");
+
+    XMLArchive__DeltaWriter writer{root, {}};
+    writer.Diff(baseline.root_.first_child(), root_.first_child());
+}
+
+pugi::xml_node XMLArchive::FindPath(pugi::xml_node root, const std::string& path, bool create, std::string& token)
+{
+    auto node = root;
+    size_t position = 0;
+    while (node && position < path.size())
+    {
+        if (!detail::NextPathToken(path, position, token))
+            return {};
+
+        const bool last = position == path.size();
+        auto first = node.first_child();
+        const bool numeric = !token.empty() && token.find_first_not_of("0123456789") == std::string::npos;
+        const bool array = first ? first.attribute("key").empty() : numeric;
+        if (!array)
+        {
+            // Keys are matched regardless of element name, user type serializers may rename elements
+            auto child = FindChild(node, token.c_str(), nullptr);
+            if (!child && create && last)
+            {
+                child = node.append_child("value");
+                child.append_attribute("key").set_value(token.c_str());
+            }
+            node = child;
+            continue;
+        }
+
+        const unsigned long index = strtoul(token.c_str(), nullptr, 10);
+        if (!numeric || index > INT_MAX || (first && first.type() != pugi::node_element))
+            return {};
+        auto child = GetChild(node, (int)index);
+        if (!child && create && last && index == (unsigned long)GetSize(node))
+            child = node.append_child("value");
+        node = child;
+    }
+    return node;
+}
+
+bool XMLArchive::ApplyDelta(const XMLArchive& delta)
+{
+    MemoryScope memoryScope(this);
+    auto root = root_.first_child();
+    if (!root)
+        return false;
+
+    std::string token;
+    for (auto item : delta.root_.first_child().children())
+    {
+        const std::string path = item.attribute("path").value();
+        if (strcmp(item.name(), "set") == 0)
+        {
+            auto target = FindPath(root, path, true, token);
+            auto value = item.first_child();
+            if (!target || !value)
+                return false;
+
+            // Target keeps its key, everything else is replaced by the value
+            target.set_name(value.name());
+            for (auto attribute = target.first_attribute(); attribute;)
+            {
+                auto next = attribute.next_attribute();
+                if (strcmp(attribute.name(), "key") != 0)
+                    target.remove_attribute(attribute);
+                attribute = next;
+            }
+            for (auto attribute : value.attributes())
+                target.append_attribute(attribute.name()).set_value(attribute.value());
+            InvalidateIndex(target);
+            while (target.first_child())
+                target.remove_child(target.first_child());
+            for (auto child : value.children())
+                target.append_copy(child);
+        }
+        else if (strcmp(item.name(), "remove") == 0)
+        {
+            auto target = path.empty() ? pugi::xml_node() : FindPath(root, path, false, token);
+            if (!target)
+                return false;
+            RemoveChild(target.parent(), target);
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+// Returns first child of indexed container with specified key and element name, or any name if name is null. Returns
+// empty node if there is none.
+static pugi::xml_node XMLArchive__FindKey(const XMLArchive::ContainerIndex& index, const char* key, const char* name)
+{
+    // First child with a given key wins, same as find_child_by_attribute()
+    size_t position = index.children_.size();
+    auto range = index.keys_.equal_range(XMLArchive__KeyHash(key));
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        auto child = index.children_[it->second];
+        if (it->second < position && strcmp(child.attribute("key").value(), key) == 0 &&
+            (name == nullptr || strcmp(child.name(), name) == 0))
+            position = it->second;
+    }
+    return position < index.children_.size() ? index.children_[position] : pugi::xml_node{};
+}
+
+// Inserts keys of children that were appended since last lookup into keys_.
+static void XMLArchive__IndexKeys(XMLArchive::ContainerIndex& index)
+{
+    for (; index.keyed_ < index.children_.size(); index.keyed_++)
+    {
+        auto child = index.children_[index.keyed_];
+        auto attribute = child.attribute("key");
+        if (!attribute.empty())
+            index.keys_.emplace(XMLArchive__KeyHash(attribute.value()), index.keyed_);
+    }
+}
+
+// Drops children removed by RemoveChild() from list of children. Positions change, therefore keys are indexed anew.
+static void XMLArchive__Compact(XMLArchive::ContainerIndex& index)
+{
+    if (index.removed_ == 0)
+        return;
+
+    index.children_.erase(std::remove(index.children_.begin(), index.children_.end(), pugi::xml_node{}),
+        index.children_.end());
+    index.removed_ = 0;
+    index.keys_.clear();
+    index.keyed_ = 0;
+}
+
+XMLArchive::ContainerIndex* XMLArchive::GetIndex(pugi::xml_node container)
+{
+    MemoryScope memoryScope(this);
+    auto it = index_.find(container.internal_object());
+    if (it == index_.end())
+    {
+        // Small containers are cheaper to walk than to index
+        size_t count = 0;
+        for (auto node = container.first_child(); node && count < XMLArchive__IndexThreshold; node = node.next_sibling())
+            count++;
+
+        if (count < XMLArchive__IndexThreshold)
+            return nullptr;
+
+        it = index_.emplace(container.internal_object(), ContainerIndex{}).first;
+    }
+    auto& index = it->second;
+
+    // Container was modified by means other than appending or removing children
+    if (index.first_ != container.first_child())
+    {
+        index = ContainerIndex{};
+        index.first_ = container.first_child();
+    }
+
+    // Pick up children that were appended since last access. Last child of the list is never a removed one.
+    auto node = index.children_.empty() ? container.first_child() : index.children_.back().next_sibling();
+    for (; node; node = node.next_sibling())
+        index.children_.push_back(node);
+
+    return &index;
+}
+
+void XMLArchive::InvalidateIndex(pugi::xml_node node)
+{
+    if (index_.empty())
+        return;
+
+    // Nodes of a subtree are visited in document order
+    index_.erase(node.internal_object());
+    for (auto child = node.first_child(); child;)
+    {
+        index_.erase(child.internal_object());
+        if (child.first_child())
+        {
+            child = child.first_child();
+            continue;
+        }
+        while (child != node && !child.next_sibling())
+            child = child.parent();
+        child = child != node ? child.next_sibling() : pugi::xml_node{};
+    }
+}
+
+void XMLArchive::RemoveChild(pugi::xml_node container, pugi::xml_node child)
+{
+    MemoryScope memoryScope(this);
+    InvalidateIndex(child);
+    auto* containerIndex = index_.count(container.internal_object()) ? GetIndex(container) : nullptr;
+    if (containerIndex != nullptr)
+    {
+        auto& index = *containerIndex;
+        if (index.first_ == child)
+            index.first_ = child.next_sibling();
+
+        // Keyed children are located through keys_, otherwise only the last child can be located cheaply
+        size_t position = index.children_.size();
+        auto key = child.attribute("key");
+        if (!key.empty())
+        {
+            XMLArchive__IndexKeys(index);
+            auto range = index.keys_.equal_range(XMLArchive__KeyHash(key.value()));
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (index.children_[it->second] == child)
+                {
+                    position = it->second;
+                    index.keys_.erase(it);
+                    break;
+                }
+            }
+        }
+        if (position == index.children_.size() && !index.children_.empty() && index.children_.back() == child)
+            position = index.children_.size() - 1;
+
+        if (position == index.children_.size())
+            index_.erase(container.internal_object());
+        else if (position + 1 < index.children_.size())
+        {
+            // Positions of keys stay valid while removed children are kept in the list
+            index.children_[position] = {};
+            index.removed_++;
+        }
+        else
+        {
+            index.children_.pop_back();
+            while (!index.children_.empty() && index.children_.back().empty())
+            {
+                index.children_.pop_back();
+                index.removed_--;
+            }
+            index.keyed_ = std::min(index.keyed_, index.children_.size());
+        }
+    }
+    container.remove_child(child);
+}
+
+int XMLArchive::GetSize(pugi::xml_node container)
+{
+    if (auto* index = GetIndex(container))
+        return (int)(index->children_.size() - index->removed_);
+
+    return (int)std::distance(container.begin(), container.end());
+}
+
+pugi::xml_node XMLArchive::GetChild(pugi::xml_node container, int index)
+{
+    if (auto* containerIndex = GetIndex(container))
+    {
+        XMLArchive__Compact(*containerIndex);
+        return index < (int)containerIndex->children_.size() ? containerIndex->children_[index] : pugi::xml_node{};
+    }
+
+    auto node = container.first_child();
+    for (; node && index > 0; index--)
+        node = node.next_sibling();
+    return node;
+}
+
+pugi::xml_node XMLArchive::FindChild(pugi::xml_node container, const char* key, const char* name)
+{
+    MemoryScope memoryScope(this);
+    auto* containerIndex = GetIndex(container);
+    if (containerIndex == nullptr)
+    {
+        if (name == nullptr)
+            return container.find_child_by_attribute("key", key);
+        return container.find_child_by_attribute(name, "key", key);
+    }
+
+    XMLArchive__IndexKeys(*containerIndex);
+    return XMLArchive__FindKey(*containerIndex, key, name);
+}
+
+#if SER_PROFILE_USER_TYPES
+size_t XMLArchive::MeasureValue(ArchiveIterator& it)
+{
+    struct xml_counting_writer: pugi::xml_writer
+    {
+        size_t size = 0;
+
+        void write(const void* /*data*/, size_t size) override
+        {
+            this->size += size;
+        }
+    };
+
+    if (!it)
+        return 0;
+
+    auto node = static_cast<InputIterator*>(it.Get())->Current();    // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    if (node.empty())
+        return 0;
+
+    xml_counting_writer writer{};
+    node.print(writer, "", pugi::format_raw);
+    return writer.size;
+}
+#endif
+
+// Name of traced span of a container: its key in parent map, or its type.
+static const char* XMLArchive__ContainerName(pugi::xml_node container, Archive::ContainerType type)
+{
+    auto key = container.attribute("key");
+    if (!key.empty())
+        return key.value();
+
+    return type == Archive::Array ? "array" : "map";
+}
+
 // ---------------------- XMLOutputArchive::XMLOutputIterator ----------------------
 
 ArchiveIterator XMLOutputArchive::OutputIterator::Construct(pugi::xml_node container, pugi::xml_node index)
 {
-    return ArchiveIterator::ConstructR<OutputIterator>(container, index);
+    return ArchiveIterator::ConstructR<OutputIterator>(archive_, container, index);
 }
 
 void XMLOutputArchive::OutputIterator::Copy(ArchiveIterator& destination) const
@@ -110,13 +998,13 @@ void XMLOutputArchive::OutputIterator::Copy(ArchiveIterator& destination) const
     ArchiveIterator::Construct<OutputIterator>(destination, *this);
 }
 
-XMLOutputArchive::OutputIterator::OutputIterator(pugi::xml_node container)
-    : InputIterator(container)
+XMLOutputArchive::OutputIterator::OutputIterator(XMLArchive* archive, pugi::xml_node container)
+    : InputIterator(archive, container)
 {
 }
 
-XMLOutputArchive::OutputIterator::OutputIterator(pugi::xml_node container, pugi::xml_node index)
-    : InputIterator(container, index)
+XMLOutputArchive::OutputIterator::OutputIterator(XMLArchive* archive, pugi::xml_node container, pugi::xml_node index)
+    : InputIterator(archive, container, index)
 {
 }
 
@@ -125,6 +1013,7 @@ pugi::xml_node XMLOutputArchive::OutputIterator::Current()
     // Automatically expanding
     if (index_.empty())
     {
+        MemoryScope memoryScope(archive_);
         container_.append_child("value");
         index_ = container_.last_child();
     }
@@ -139,10 +1028,12 @@ bool XMLOutputArchive::OutputIterator::AtEnd() const
 
 ArchiveIterator XMLOutputArchive::OutputIterator::operator[](int index)
 {
-    if (container_.empty())
+    if (container_.empty() || index < 0)
         return {};
 
-    while (index < Size())
+    // Size() is cheap, cached list of children is extended with each appended node
+    MemoryScope memoryScope(archive_);
+    while (Size() <= index)
         container_.append_child("value");
 
     return InputIterator::operator[](index);
@@ -153,9 +1044,12 @@ ArchiveIterator XMLOutputArchive::OutputIterator::Find(const std::string& key)
     if (container_.empty())
         return ArchiveIterator{};
 
-    auto node = container_.find_child_by_attribute("value", "key", key.c_str());
+    detail::CountMetric(detail::XMLMetrics, detail::FindCounter);
+    auto node = archive_->FindChild(container_, key.c_str());
     if (node.empty())
     {
+        detail::CountMetric(detail::XMLMetrics, detail::FindMissCounter);
+        MemoryScope memoryScope(archive_);
         node = container_.append_child("value");
         node.append_attribute("key").set_value(key.c_str());
     }
@@ -166,37 +1060,59 @@ ArchiveIterator XMLOutputArchive::OutputIterator::Find(const std::string& key)
 // ---------------------- XMLOutputArchive ----------------------
 
 template<typename T>
-static bool XMLOutputArchive__SerializeValueHelper(ArchiveIterator& it, T& value)
+static bool XMLOutputArchive__SerializeValueHelper(XMLArchive* archive, ArchiveIterator& it, T& value)
 {
+    detail::CountMetric(detail::XMLMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
+    XMLArchive::MemoryScope memoryScope(archive);
     if (auto current = static_cast<XMLInputArchive::InputIterator*>(it.Get())->Current())   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
     {
-        current.append_child(pugi::node_pcdata).set_value(std::to_string(value).c_str());   // TODO: possibly sucks
-        return true;
+        char buffer[32];
+        return current.text().set(XMLArchive__FormatValue(value, buffer));
     }
     return false;
 }
 
-static ArchiveIterator XMLOutputArchive__BeginHelper(pugi::xml_node target, Archive::ContainerType type)
+static ArchiveIterator XMLOutputArchive__BeginHelper(XMLArchive* archive, pugi::xml_node target, Archive::ContainerType /*type*/)
 {
-    return ArchiveIterator::ConstructR<XMLOutputArchive::OutputIterator>(target);
+    detail::CountMetric(detail::XMLMetrics, detail::BeginCounter);
+    return ArchiveIterator::ConstructR<XMLOutputArchive::OutputIterator>(archive, target);
 }
 
-XMLOutputArchive::XMLOutputArchive()
+XMLOutputArchive::XMLOutputArchive(MemoryResource* resource)
+    : XMLArchive(resource)
 {
+    MemoryScope memoryScope(this);
+    root_.append_child("root");
+}
+
+void XMLOutputArchive::Reset(size_t highWaterMark)
+{
+    XMLArchive::Reset(highWaterMark);
+
+    MemoryScope memoryScope(this);
     root_.append_child("root");
 }
 
 ArchiveIterator XMLOutputArchive::Begin(ArchiveIterator&& it, Archive::ContainerType type)
 {
-    return XMLOutputArchive__BeginHelper(static_cast<InputIterator*>(it.Get())->Current(), type);   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto target = static_cast<InputIterator*>(it.Get())->Current();   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto result = XMLOutputArchive__BeginHelper(this, target, type);
+    if (Tracer::IsEnabled())
+    {
+        const char* name = XMLArchive__ContainerName(target, type);
+        TraceContainer(result, name, strlen(name));
+    }
+    return result;
 }
 
 ArchiveIterator XMLOutputArchive::Begin(Archive::ContainerType type)
 {
-    return XMLOutputArchive__BeginHelper(root_.root().first_child(), type);
+    auto result = XMLOutputArchive__BeginHelper(this, root_.root().first_child(), type);
+    TraceContainer(result, "root", 4);
+    return result;
 }
 
 std::string XMLOutputArchive::ToString() const
@@ -211,139 +1127,289 @@ std::string XMLOutputArchive::ToString() const
         }
     };
 
+    detail::TraceScope traceScope("archive", "ToString", 8);
+    detail::Stopwatch stopwatch;
     xml_string_writer xml_writer{};
     root_.save(xml_writer);
+
+    detail::CountMetric(detail::XMLMetrics, detail::BytesOutCounter, xml_writer.result.size());
+    detail::RecordLatency(detail::XMLMetrics, detail::ToStringLatency, stopwatch.Elapsed());
     return xml_writer.result;
 }
 
-bool XMLOutputArchive::Serialize(ArchiveIterator&& it, std::string& value)
+bool XMLOutputArchive::Save(Sink& sink) const
+{
+    struct xml_sink_writer: pugi::xml_writer
+    {
+        Sink& sink;
+        size_t total;
+        bool written;
+
+        xml_sink_writer(Sink& sink) : sink(sink), total(0), written(true) { }
+
+        void write(const void* data, size_t size) override
+        {
+            written = sink.Write(data, size) && written;
+            total += size;
+        }
+    };
+
+    detail::TraceScope traceScope("archive", "Save", 4);
+    detail::Stopwatch stopwatch;
+    xml_sink_writer xml_writer(sink);
+    root_.save(xml_writer);
+
+    detail::CountMetric(detail::XMLMetrics, detail::BytesOutCounter, xml_writer.total);
+    detail::RecordLatency(detail::XMLMetrics, detail::ToStringLatency, stopwatch.Elapsed());
+    return xml_writer.written;
+}
+
+bool XMLOutputArchive::SerializeParallel(ArchiveIterator&& it, size_t count, ElementSerializer serializer,
+    void* context, unsigned threads)
 {
     if (!it)
         return false;
 
-    if (auto current = ((InputIterator*)it.Get())->Current())
+    auto target = static_cast<InputIterator*>(it.Get())->Current();   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto array = Begin((ArchiveIterator&&)it, Array);
+    const unsigned chunks = detail::GetParallelChunks(count, threads);
+    if (chunks < 2 || !target.first_child().empty())
     {
-        current.set_value(value.c_str());
-        return true;
+        // Serializer may write nodes through iterators directly
+        MemoryScope memoryScope(this);
+        return SerializeRange(array, 0, count, serializer, context);
+    }
+
+    // Memory resources are not thread-safe, therefore fragments allocate from heap or page pool of worker. Calling
+    // thread may run a chunk too, scope of fragment replaces resource current there.
+    std::vector<std::unique_ptr<XMLOutputArchive>> fragments(chunks);
+    std::vector<char> results(chunks);
+    detail::ParallelForChunks(count, chunks, [&](unsigned chunk, size_t begin, size_t end) {
+        fragments[chunk].reset(new XMLOutputArchive(nullptr));
+        MemoryScope memoryScope(fragments[chunk].get());
+        auto fragmentArray = fragments[chunk]->Begin(Array);
+        results[chunk] = fragments[chunk]->SerializeRange(fragmentArray, begin, end, serializer, context);
+    });
+
+    // Nodes can not be moved between pugixml documents. Copying them is sequential, but cheaper than serializing.
+    MemoryScope memoryScope(this);
+    bool result = true;
+    for (unsigned chunk = 0; chunk < chunks; chunk++)
+    {
+        for (auto element : fragments[chunk]->root_.first_child().children())
+            target.append_copy(element);
+        result = result && results[chunk] != 0;
+        fragments[chunk].reset();
     }
+    return result;
+}
+
+// Node written by a user type serializer, owned by SerializationCache. Children are kept as XML text.
+struct XMLOutputArchive__CachedValue : detail::CachedValue
+{
+    std::string name_;
+    std::vector<std::pair<std::string, std::string>> attributes_;
+    std::string text_;
+};
+
+bool XMLOutputArchive::SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& cache)
+{
+    struct xml_string_writer: pugi::xml_writer
+    {
+        std::string& result;
+
+        explicit xml_string_writer(std::string& result) : result(result) { }
+
+        void write(const void* data, size_t size) override
+        {
+            result.append(static_cast<const char*>(data), size);
+        }
+    };
+
+    if (!it)
+        return false;
+
+    auto target = static_cast<InputIterator*>(it.Get())->Current();   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    if (target.empty())
+        return false;
+
+    // Text is written without indentation, therefore whitespace-only text is a value and is kept when parsing it
+    const unsigned format = detail::type_id<XMLOutputArchive>();
+    const unsigned options = (pugi::parse_default | pugi::parse_ws_pcdata) & ~pugi::parse_eol;
+    if (auto cached = cache.Get(format))
+    {
+        detail::CountMetric(detail::XMLMetrics, detail::CacheHitCounter);
+        MemoryScope memoryScope(this);
+        const auto& entry = static_cast<const XMLOutputArchive__CachedValue&>(*cached);
+        target.set_name(entry.name_.c_str());
+        for (const auto& attribute : entry.attributes_)
+            target.append_attribute(attribute.first.c_str()).set_value(attribute.second.c_str());
+        return entry.text_.empty() ||
+            target.append_buffer(entry.text_.data(), entry.text_.size(), options, pugi::encoding_utf8);
+    }
+
+    detail::CountMetric(detail::XMLMetrics, detail::CacheMissCounter);
+    if (!Serialize((ArchiveIterator&&)it, typeId, value))
+        return false;
+
+    // Key of target belongs to its container, serializer may rename target and add attributes of its own
+    auto entry = std::make_shared<XMLOutputArchive__CachedValue>();
+    entry->name_ = target.name();
+    for (auto attribute : target.attributes())
+    {
+        if (strcmp(attribute.name(), "key") != 0)
+            entry->attributes_.emplace_back(attribute.name(), attribute.value());
+    }
+    xml_string_writer writer(entry->text_);
+    for (auto child : target.children())
+        child.print(writer, "", pugi::format_raw, pugi::encoding_utf8);
+    cache.Set(format, std::move(entry));
+    return true;
+}
+
+bool XMLOutputArchive::Serialize(ArchiveIterator&& it, std::string& value)
+{
+    detail::CountMetric(detail::XMLMetrics, detail::SerializeCounter);
+    if (!it)
+        return false;
+
+    MemoryScope memoryScope(this);
+    if (auto current = ((InputIterator*)it.Get())->Current())
+        return current.text().set(value.c_str());
     return false;
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, bool& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, int8_t& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, uint8_t& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, int16_t& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, uint16_t& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, int32_t& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, uint32_t& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, int64_t& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, uint64_t& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, float& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 bool XMLOutputArchive::Serialize(ArchiveIterator&& it, double& value)
 {
-    return XMLOutputArchive__SerializeValueHelper(it, value);
+    return XMLOutputArchive__SerializeValueHelper(this, it, value);
 }
 
 // ---------------------- XMLInputArchive ----------------------
 
 template<typename T>
-typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, bool>::type
-XMLInputArchive__SerializeValueHelper(ArchiveIterator& it, T& value)
+static bool XMLInputArchive__SerializeValueHelper(ArchiveIterator& it, T& value)
 {
+    detail::CountMetric(detail::XMLMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
     if (auto current = static_cast<XMLInputArchive::InputIterator*>(it.Get())->Current())   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
-    {
-        size_t pos = 0;
-        value = (T)std::stoull(current.value(), &pos);
-        return pos > 0;
-    }
+        return XMLArchive__ParseValue(current.text().get(), value);
     return false;
 }
 
-template<typename T>
-typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, bool>::type
-XMLInputArchive__SerializeValueHelper(ArchiveIterator& it, T& value)
+XMLInputArchive::XMLInputArchive(MemoryResource* resource)
+    : XMLArchive(resource)
 {
-    if (!it)
-        return false;
+}
 
-    if (auto current = static_cast<XMLInputArchive::InputIterator*>(it.Get())->Current())   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
-    {
-        size_t pos = 0;
-        value = (T)std::stoll(current.first_child().value(), &pos);
-        return pos > 0;
-    }
-    return false;
+XMLInputArchive::XMLInputArchive(const std::string& xml_data, MemoryResource* resource)
+    : XMLArchive(resource)
+{
+    Load(xml_data);
+}
+
+bool XMLInputArchive::Load(const std::string& xml_data)
+{
+    detail::TraceScope traceScope("archive", "Parse", 5);
+    detail::Stopwatch stopwatch;
+    MemoryScope memoryScope(this);
+    index_.clear();
+    bool result = root_.load_string(xml_data.c_str());
+
+    detail::CountMetric(detail::XMLMetrics, detail::BytesInCounter, xml_data.size());
+    detail::RecordLatency(detail::XMLMetrics, detail::ParseLatency, stopwatch.Elapsed());
+    return result;
 }
 
-XMLInputArchive::XMLInputArchive(const std::string& xml_data)
+bool XMLInputArchive::Load(const char* data, size_t size)
 {
-    root_.load_string(xml_data.c_str());
+    detail::TraceScope traceScope("archive", "Parse", 5);
+    detail::Stopwatch stopwatch;
+    MemoryScope memoryScope(this);
+    index_.clear();
+    // pugixml parses a private copy of the buffer, same as load_string() does
+    bool result = root_.load_buffer(data, size, pugi::parse_default, pugi::encoding_utf8);
+
+    detail::CountMetric(detail::XMLMetrics, detail::BytesInCounter, size);
+    detail::RecordLatency(detail::XMLMetrics, detail::ParseLatency, stopwatch.Elapsed());
+    return result;
 }
 
 ArchiveIterator XMLInputArchive::Begin(ArchiveIterator&& it, Archive::ContainerType type)
 {
-    return ArchiveIterator::ConstructR<InputIterator>(static_cast<InputIterator*>(it.Get())->Current());    // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    detail::CountMetric(detail::XMLMetrics, detail::BeginCounter);
+    auto target = static_cast<InputIterator*>(it.Get())->Current();   // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
+    auto result = ArchiveIterator::ConstructR<InputIterator>(this, target);
+    if (Tracer::IsEnabled())
+    {
+        const char* name = XMLArchive__ContainerName(target, type);
+        TraceContainer(result, name, strlen(name));
+    }
+    return result;
 }
 
-ArchiveIterator XMLInputArchive::Begin(Archive::ContainerType type)
+ArchiveIterator XMLInputArchive::Begin(Archive::ContainerType /*type*/)
 {
-    return ArchiveIterator::ConstructR<InputIterator>(root_.root().first_child());
+    detail::CountMetric(detail::XMLMetrics, detail::BeginCounter);
+    auto result = ArchiveIterator::ConstructR<InputIterator>(this, root_.root().first_child());
+    TraceContainer(result, "root", 4);
+    return result;
 }
 
 bool XMLInputArchive::Serialize(ArchiveIterator&& it, bool& value)
 {
-    if (!it)
-        return false;
-
-    if (auto current = ((InputIterator*)it.Get())->Current())
-    {
-        value = strcmp(current.value(), "true") == 0;
-        return true;
-    }
-    return false;
+    return XMLInputArchive__SerializeValueHelper(it, value);
 }
 
 bool XMLInputArchive::Serialize(ArchiveIterator&& it, int8_t& value)
@@ -388,40 +1454,23 @@ bool XMLInputArchive::Serialize(ArchiveIterator&& it, uint64_t& value)
 
 bool XMLInputArchive::Serialize(ArchiveIterator&& it, float& value)
 {
-    if (!it)
-        return false;
-
-    if (auto current = ((InputIterator*)it.Get())->Current())
-    {
-        size_t pos = 0;
-        value = std::stof(current.first_child().value(), &pos);
-        return pos > 0;
-    }
-    return false;
+    return XMLInputArchive__SerializeValueHelper(it, value);
 }
 
 bool XMLInputArchive::Serialize(ArchiveIterator&& it, double& value)
 {
-    if (!it)
-        return false;
-
-    if (auto current = ((InputIterator*)it.Get())->Current())
-    {
-        size_t pos = 0;
-        value = std::stod(current.first_child().value(), &pos);
-        return pos > 0;
-    }
-    return false;
+    return XMLInputArchive__SerializeValueHelper(it, value);
 }
 
 bool XMLInputArchive::Serialize(ArchiveIterator&& it, std::string& value)
 {
+    detail::CountMetric(detail::XMLMetrics, detail::SerializeCounter);
     if (!it)
         return false;
 
     if (auto current = ((InputIterator*)it.Get())->Current())
     {
-        value = current.first_child().value();
+        value = current.text().get();
         return true;
     }
     return false;
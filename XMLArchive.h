@@ -25,9 +25,13 @@
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 #include "pugixml/pugixml.hpp"
 
 #include "Archive.h"
+#include "Memory.h"
+#include "Sink.h"
 
 namespace ser
 {
@@ -43,8 +47,8 @@ public:
         void Copy(ArchiveIterator& destination) const override;
 
     public:
-        explicit InputIterator(pugi::xml_node container);
-        explicit InputIterator(pugi::xml_node container, pugi::xml_node index);
+        explicit InputIterator(XMLArchive* archive, pugi::xml_node container);
+        explicit InputIterator(XMLArchive* archive, pugi::xml_node container, pugi::xml_node index);
         InputIterator(const InputIterator& other) = default;
 
         virtual pugi::xml_node Current();
@@ -56,11 +60,98 @@ public:
         ArchiveIterator operator[](int index) override;
         void operator++() override;
 
+        XMLArchive* archive_ = nullptr;
         pugi::xml_node container_{};
         pugi::xml_node index_{};
     };
 
+    /// Makes resource and memory stats of an archive current for the lifetime of this object. pugixml documents and
+    /// lookup structures allocate from current resource of calling thread, therefore every operation which allocates
+    /// memory of an archive opens a scope.
+    class MemoryScope
+    {
+    public:
+        explicit MemoryScope(XMLArchive* archive)
+            : resourceScope_(archive->resource_)
+            , statsScope_(&archive->memoryStats_)
+        {
+        }
+
+    private:
+        /// Makes resource of archive current.
+        MemoryResourceScope resourceScope_;
+        /// Makes memory stats of archive current.
+        detail::MemoryStatsScope statsScope_;
+    };
+
+    /// Construct archive which allocates document memory from specified resource, or heap if it is null. pugixml
+    /// allocates through memory functions of archives from then on.
+    explicit XMLArchive(MemoryResource* resource);
+
     pugi::xml_document root_;
+
+    /// Clear document. Memory pages of pugixml documents are kept in a per-thread pool when freed, therefore documents
+    /// of similar size do not allocate any memory after a reset. If highWaterMark is not 0 then pool of current thread
+    /// is trimmed down to that amount of bytes.
+    void Reset(size_t highWaterMark = 0) override;
+    /// Free pooled memory pages of current thread until no more than specified amount of bytes remain in the pool.
+    static void TrimPagePool(size_t bytes);
+    /// Write values of this document that differ from specified baseline into document of delta archive, replacing it.
+    /// Root of delta holds a "set" element with a copy of each changed value, including its name and attributes, and a
+    /// "remove" element for each removed value, both with "path" attribute (JSON Pointer, RFC 6901) made of keys and
+    /// indices of containers.
+    void MakeDelta(const XMLArchive& baseline, XMLArchive& delta) const;
+    /// Apply delta made by MakeDelta() to this document, which must be the baseline delta was made against. Document
+    /// becomes equal to the document delta was made from. Returns false if delta is malformed or does not match this
+    /// document, which may be partially modified then.
+    bool ApplyDelta(const XMLArchive& delta);
+
+    /// Lookup structures of a single container.
+    struct ContainerIndex
+    {
+        /// Children of container in document order. Children removed by RemoveChild() are left as empty nodes until
+        /// next indexed access or size query.
+        std::vector<pugi::xml_node, detail::ScopeAllocator<pugi::xml_node>> children_;
+        /// Keyed children of container, mapped by hash of their key to their position in children_.
+        std::unordered_multimap<unsigned, size_t, std::hash<unsigned>, std::equal_to<unsigned>,
+            detail::ScopeAllocator<std::pair<const unsigned, size_t>>> keys_;
+        /// Number of children that were already inserted into keys_.
+        size_t keyed_ = 0;
+        /// Number of empty nodes in children_.
+        size_t removed_ = 0;
+        /// First child of container when it was indexed, index is rebuilt if container starts with another child.
+        pugi::xml_node first_{};
+    };
+
+    /// Returns lookup structures of specified container or null if container is small enough to be searched linearly.
+    /// Lookup structures are built on first access and extended when new children are appended to the container,
+    /// therefore indexed access, key lookup and size queries take constant time. Children must be removed through
+    /// RemoveChild(), any other modification except appending requires InvalidateIndex().
+    ContainerIndex* GetIndex(pugi::xml_node container);
+    /// Discard lookup structures of specified node and its descendants.
+    void InvalidateIndex(pugi::xml_node node);
+    /// Remove child of specified container, keeping lookup structures of container up to date.
+    void RemoveChild(pugi::xml_node container, pugi::xml_node child);
+    /// Returns number of children of specified container.
+    int GetSize(pugi::xml_node container);
+    /// Returns child of specified container at specified index or empty node.
+    pugi::xml_node GetChild(pugi::xml_node container, int index);
+    /// Returns first child of specified container with specified key and element name, or any name if name is null.
+    /// Returns empty node if there is none.
+    pugi::xml_node FindChild(pugi::xml_node container, const char* key, const char* name = "value");
+    /// Returns node at specified path (JSON Pointer) below specified root, or empty node if there is none. Missing key
+    /// or element one past the end of an array is created if requested. Last token of path is returned in token.
+    pugi::xml_node FindPath(pugi::xml_node root, const std::string& path, bool create, std::string& token);
+#if SER_PROFILE_USER_TYPES
+    size_t MeasureValue(ArchiveIterator& it) override;
+#endif
+
+protected:
+    /// Resource document memory is allocated from, null for heap.
+    MemoryResource* resource_ = nullptr;
+    /// Cached lookup structures of containers.
+    std::unordered_map<pugi::xml_node_struct*, ContainerIndex, std::hash<pugi::xml_node_struct*>,
+        std::equal_to<pugi::xml_node_struct*>, detail::ScopeAllocator<std::pair<pugi::xml_node_struct* const, ContainerIndex>>> index_;
 };
 
 class XMLOutputArchive : public XMLArchive
@@ -73,8 +164,8 @@ public:
         ArchiveIterator Construct(pugi::xml_node container, pugi::xml_node index) override;
         void Copy(ArchiveIterator& destination) const override;
     public:
-        explicit OutputIterator(pugi::xml_node container);
-        explicit OutputIterator(pugi::xml_node container, pugi::xml_node index);
+        explicit OutputIterator(XMLArchive* archive, pugi::xml_node container);
+        explicit OutputIterator(XMLArchive* archive, pugi::xml_node container, pugi::xml_node index);
         OutputIterator(const OutputIterator& other) = default;
 
         pugi::xml_node Current() override;
@@ -88,14 +179,31 @@ private:
 SER_USER_CONTAINER(XMLOutputArchive);
 public:
 
-    XMLOutputArchive();
+    /// Construct archive which allocates memory from specified resource, or heap if it is null.
+    explicit XMLOutputArchive(MemoryResource* resource = MemoryResourceScope::Current());
+
+    /// Clear document and prepare it for writing.
+    void Reset(size_t highWaterMark = 0) override;
 
     /// Begin writing to container of specified type. Container pointed by specified iterator will be converted to specified type.
     ArchiveIterator Begin(ArchiveIterator&& it, ContainerType type) override;
     /// Begin writing to container of specified type. Root container will be converted to specified type.
     ArchiveIterator Begin(ContainerType type) override;
-    /// Return serialized JSON result.
+    /// Return serialized XML result.
     std::string ToString() const;
+    /// Write serialized XML to specified sink as it is formatted, without building a string. Output is the same as
+    /// ToString(). Returns false if sink failed to write.
+    bool Save(Sink& sink) const;
+
+    using Archive::SerializeParallel;
+    /// Serialize chunks of array into documents of their own on multiple threads, then copy their nodes into the array.
+    bool SerializeParallel(ArchiveIterator&& it, size_t count, ElementSerializer serializer, void* context,
+        unsigned threads = 0) override;
+    using Archive::SerializeCached;
+    /// Serialize user type through specified cache, which stores children of its node as XML text. Nodes can not be
+    /// shared between pugixml documents, therefore cached text is parsed into the document, which is still cheaper
+    /// than serializing.
+    bool SerializeCached(ArchiveIterator&& it, unsigned typeId, void* value, SerializationCache& cache) override;
 
     bool Serialize(ArchiveIterator&& it, bool& value) override;
     bool Serialize(ArchiveIterator&& it, int8_t& value) override;
@@ -118,8 +226,16 @@ public:
 private:
     SER_USER_CONTAINER(XMLInputArchive);
 public:
+    /// Construct empty input archive which allocates memory from specified resource, or heap if it is null. Use Load()
+    /// to read xml.
+    explicit XMLInputArchive(MemoryResource* resource = MemoryResourceScope::Current());
     /// Construct input archive that will read specified xml.
-    explicit XMLInputArchive(const std::string& xml_data);
+    explicit XMLInputArchive(const std::string& xml_data, MemoryResource* resource = MemoryResourceScope::Current());
+    /// Parse specified xml into the document, replacing previous one. Returns false if xml is malformed.
+    bool Load(const std::string& xml_data);
+    /// Parse xml in specified memory range into the document. Memory is only read during the call and does not need to
+    /// be null-terminated.
+    bool Load(const char* data, size_t size);
     /// Begin iterating container of specified type at specified iterator.
     ArchiveIterator Begin(ArchiveIterator&& it, ContainerType type) override;
     /// Begin iterating container of specified type at archive root.
@@ -0,0 +1,471 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "Tracer.h"
+
+// ---------------------- Allocation counting ----------------------
+
+static std::atomic<size_t> Benchmark__allocationCount{0};
+static std::atomic<size_t> Benchmark__allocatedBytes{0};
+
+#if defined(__GLIBC__)
+// Interpose heap functions, so that allocations of std containers, rapidjson chunks and pugixml pages are all counted
+// without changing how archives allocate memory.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+extern "C" void* malloc(size_t size)
+{
+    Benchmark__allocationCount.fetch_add(1, std::memory_order_relaxed);
+    Benchmark__allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    Benchmark__allocationCount.fetch_add(1, std::memory_order_relaxed);
+    Benchmark__allocatedBytes.fetch_add(count * size, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    Benchmark__allocationCount.fetch_add(1, std::memory_order_relaxed);
+    Benchmark__allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+#else
+// Only allocations made through operator new are counted on this platform.
+void* operator new(size_t size)
+{
+    Benchmark__allocationCount.fetch_add(1, std::memory_order_relaxed);
+    Benchmark__allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+namespace ser
+{
+
+namespace bench
+{
+
+size_t GetAllocationCount()
+{
+    return Benchmark__allocationCount.load(std::memory_order_relaxed);
+}
+
+size_t GetAllocatedBytes()
+{
+    return Benchmark__allocatedBytes.load(std::memory_order_relaxed);
+}
+
+// ---------------------- Suite ----------------------
+
+void Suite::Add(const std::string& group, const std::string& archive, const std::string& operation, Function function)
+{
+    benchmarks_.push_back({group, archive, operation, std::move(function), {}});
+}
+
+void Suite::AddComparison(const std::string& group, const std::string& operation, const std::string& archive,
+    Function function, const std::string& baselineArchive, Function baselineFunction)
+{
+    benchmarks_.push_back({group, baselineArchive, operation, std::move(baselineFunction), {}});
+    benchmarks_.push_back({group, archive, operation, std::move(function), baselineArchive});
+}
+
+void Suite::AddScaling(const std::string& group, const std::string& archive, const std::string& operation,
+    ScalingFunction function)
+{
+    scaling_.push_back({group, archive, operation, std::move(function)});
+}
+
+// Least squares slope of log(y) over log(x).
+static double Benchmark__FitExponent(const std::vector<double>& x, const std::vector<double>& y)
+{
+    double meanX = 0, meanY = 0;
+    for (size_t i = 0; i < x.size(); i++)
+    {
+        meanX += std::log(x[i]);
+        meanY += std::log(y[i]);
+    }
+    meanX /= (double)x.size();
+    meanY /= (double)x.size();
+
+    double covariance = 0, variance = 0;
+    for (size_t i = 0; i < x.size(); i++)
+    {
+        double dx = std::log(x[i]) - meanX;
+        covariance += dx * (std::log(y[i]) - meanY);
+        variance += dx * dx;
+    }
+    return variance > 0 ? covariance / variance : 0;
+}
+
+Result Suite::Measure(const std::string& group, const std::string& archive, const std::string& operation,
+    const Function& function, double minTime)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Warm up caches and pools
+    function();
+
+    size_t iterations = 0;
+    size_t bytes = 0;
+    size_t batch = 1;
+    const size_t allocationsStart = GetAllocationCount();
+    const size_t allocatedStart = GetAllocatedBytes();
+    const auto start = Clock::now();
+    double elapsed = 0;
+    for (;;)
+    {
+        for (size_t i = 0; i < batch; i++)
+            bytes += function();
+        iterations += batch;
+
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (elapsed >= minTime && iterations >= 3)
+            break;
+
+        // Check clock less often for fast operations
+        if (elapsed < minTime / 10)
+            batch *= 2;
+    }
+
+    Result result;
+    result.group_ = group;
+    result.archive_ = archive;
+    result.operation_ = operation;
+    result.iterations_ = iterations;
+    result.nsPerOp_ = elapsed * 1e9 / (double)iterations;
+    result.bytesPerOp_ = (double)bytes / (double)iterations;
+    result.allocationsPerOp_ = (double)(GetAllocationCount() - allocationsStart) / (double)iterations;
+    result.allocatedBytesPerOp_ = (double)(GetAllocatedBytes() - allocatedStart) / (double)iterations;
+    result.mbPerSecond_ = (double)bytes / elapsed / (1024.0 * 1024.0);
+    return result;
+}
+
+std::vector<Result> Suite::Run(const Options& options) const
+{
+    std::vector<Result> results;
+    for (const auto& benchmark : benchmarks_)
+    {
+        std::string name = benchmark.group_ + "/" + benchmark.archive_ + "/" + benchmark.operation_;
+        if (!options.filter_.empty() && name.find(options.filter_) == std::string::npos)
+            continue;
+
+        auto result = Measure(benchmark.group_, benchmark.archive_, benchmark.operation_, benchmark.function_,
+            options.minTime_);
+
+        if (!benchmark.baseline_.empty())
+        {
+            for (const auto& baseline : results)
+            {
+                if (baseline.group_ == result.group_ && baseline.operation_ == result.operation_ &&
+                    baseline.archive_ == benchmark.baseline_ && baseline.nsPerOp_ > 0)
+                {
+                    result.baseline_ = baseline.archive_;
+                    result.baselineRatio_ = result.nsPerOp_ / baseline.nsPerOp_;
+                }
+            }
+        }
+
+        fprintf(stderr, "%-48s %14.0f ns/op %10.1f MB/s %10.1f allocs/op %12.0f B/op", name.c_str(), result.nsPerOp_,
+            result.mbPerSecond_, result.allocationsPerOp_, result.bytesPerOp_);
+        if (!result.baseline_.empty())
+            fprintf(stderr, " %6.2fx %s", result.baselineRatio_, result.baseline_.c_str());
+        fprintf(stderr, "\n");
+
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+std::vector<ScalingResult> Suite::RunScaling(const Options& options) const
+{
+    std::vector<ScalingResult> results;
+    for (const auto& scaling : scaling_)
+    {
+        std::string name = scaling.group_ + "/" + scaling.archive_ + "/" + scaling.operation_;
+        if (!options.filter_.empty() && name.find(options.filter_) == std::string::npos)
+            continue;
+
+        ScalingResult result;
+        result.group_ = scaling.group_;
+        result.archive_ = scaling.archive_;
+        result.operation_ = scaling.operation_;
+
+        std::vector<double> sizes, linearithmic;
+        for (size_t size = options.minSize_; size <= options.maxSize_; size *= 10)
+        {
+            auto measured = Measure(scaling.group_, scaling.archive_, scaling.operation_, scaling.function_(size),
+                options.minTime_);
+            result.sizes_.push_back(size);
+            result.nsPerOp_.push_back(measured.nsPerOp_);
+            sizes.push_back((double)size);
+            linearithmic.push_back(measured.nsPerOp_ / ((double)size * std::log2((double)size)));
+            fprintf(stderr, "%-48s %10zu %14.0f ns/op\n", name.c_str(), size, measured.nsPerOp_);
+        }
+
+        if (sizes.size() < 2)
+            continue;
+
+        result.exponent_ = Benchmark__FitExponent(sizes, result.nsPerOp_);
+        result.excessExponent_ = Benchmark__FitExponent(sizes, linearithmic);
+        result.passed_ = result.excessExponent_ <= options.maxExcessExponent_;
+        fprintf(stderr, "%-48s O(n^%.2f) %s\n", name.c_str(), result.exponent_,
+            result.passed_ ? "ok" : "FAILED: grows faster than O(n log n)");
+
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+static void Benchmark__WriteBuildInfo(rapidjson::PrettyWriter<rapidjson::StringBuffer>& writer)
+{
+    writer.Key("build");
+    writer.StartObject();
+    writer.Key("optimized");
+#if defined(__OPTIMIZE__) || defined(NDEBUG)
+    writer.Bool(true);
+#else
+    writer.Bool(false);
+#endif
+    writer.Key("compiler");
+#if defined(__VERSION__)
+    writer.String(__VERSION__);
+#else
+    writer.String("unknown");
+#endif
+    writer.EndObject();
+}
+
+std::string ToJSON(const std::vector<Result>& results)
+{
+    rapidjson::StringBuffer buffer;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+    writer.SetIndent(' ', 4);
+
+    writer.StartObject();
+    Benchmark__WriteBuildInfo(writer);
+
+    writer.Key("benchmarks");
+    writer.StartArray();
+    for (const auto& result : results)
+    {
+        writer.StartObject();
+        writer.Key("group");
+        writer.String(result.group_.c_str());
+        writer.Key("archive");
+        writer.String(result.archive_.c_str());
+        writer.Key("operation");
+        writer.String(result.operation_.c_str());
+        writer.Key("iterations");
+        writer.Uint64(result.iterations_);
+        writer.Key("ns_per_op");
+        writer.Double(result.nsPerOp_);
+        writer.Key("bytes_per_op");
+        writer.Double(result.bytesPerOp_);
+        writer.Key("allocations_per_op");
+        writer.Double(result.allocationsPerOp_);
+        writer.Key("allocated_bytes_per_op");
+        writer.Double(result.allocatedBytesPerOp_);
+        writer.Key("mb_per_second");
+        writer.Double(result.mbPerSecond_);
+        if (!result.baseline_.empty())
+        {
+            writer.Key("baseline");
+            writer.String(result.baseline_.c_str());
+            writer.Key("ratio_to_baseline");
+            writer.Double(result.baselineRatio_);
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+
+    return buffer.GetString();
+}
+
+std::string ToJSON(const std::vector<ScalingResult>& results)
+{
+    rapidjson::StringBuffer buffer;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+    writer.SetIndent(' ', 4);
+
+    writer.StartObject();
+    Benchmark__WriteBuildInfo(writer);
+
+    writer.Key("scaling");
+    writer.StartArray();
+    for (const auto& result : results)
+    {
+        writer.StartObject();
+        writer.Key("group");
+        writer.String(result.group_.c_str());
+        writer.Key("archive");
+        writer.String(result.archive_.c_str());
+        writer.Key("operation");
+        writer.String(result.operation_.c_str());
+        writer.Key("sizes");
+        writer.StartArray();
+        for (size_t size : result.sizes_)
+            writer.Uint64(size);
+        writer.EndArray();
+        writer.Key("ns_per_op");
+        writer.StartArray();
+        for (double ns : result.nsPerOp_)
+            writer.Double(ns);
+        writer.EndArray();
+        writer.Key("exponent");
+        writer.Double(result.exponent_);
+        writer.Key("excess_exponent");
+        writer.Double(result.excessExponent_);
+        writer.Key("passed");
+        writer.Bool(result.passed_);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+
+    return buffer.GetString();
+}
+
+}   // namespace bench
+
+}   // namespace ser
+
+using namespace ser::bench;
+
+int main(int argc, char** argv)
+{
+    Options options;
+    bool scaling = false;
+    std::string trace;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--scaling") == 0)
+            scaling = true;
+        else if (strncmp(arg, "--min-size=", 11) == 0)
+            options.minSize_ = strtoull(arg + 11, nullptr, 10);
+        else if (strncmp(arg, "--max-size=", 11) == 0)
+            options.maxSize_ = strtoull(arg + 11, nullptr, 10);
+        else if (strncmp(arg, "--min-time=", 11) == 0)
+            options.minTime_ = atof(arg + 11);
+        else if (strncmp(arg, "--filter=", 9) == 0)
+            options.filter_ = arg + 9;
+        else if (strncmp(arg, "--output=", 9) == 0)
+            options.output_ = arg + 9;
+        else if (strncmp(arg, "--trace=", 8) == 0)
+            trace = arg + 8;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--min-time=seconds] [--filter=substring] [--output=file.json] "
+                "[--trace=file.json] [--scaling [--min-size=n] [--max-size=n]]\n", argv[0]);
+            return 1;
+        }
+    }
+
+#if !defined(__OPTIMIZE__) && !defined(NDEBUG)
+    fprintf(stderr, "Warning: benchmarks are built without optimizations, configure with -DCMAKE_BUILD_TYPE=Release.\n");
+#endif
+
+    Suite suite;
+    AddShapeBenchmarks(suite);
+    AddOverheadBenchmarks(suite);
+    AddScalingChecks(suite);
+    AddParallelBenchmarks(suite);
+    AddCompressionBenchmarks(suite);
+    AddCachedBenchmarks(suite);
+
+    // Timings of a traced run include cost of recording events
+    if (!trace.empty())
+        ser::Tracer::Start();
+
+    std::string report;
+    bool passed = true;
+    if (scaling)
+    {
+        // Operations growing faster than O(n log n) fail the run
+        auto results = suite.RunScaling(options);
+        for (const auto& result : results)
+            passed = passed && result.passed_;
+        report = ToJSON(results);
+    }
+    else
+        report = ToJSON(suite.Run(options));
+
+    // Only available when library is built with SER_PROFILE_USER_TYPES
+    std::string userTypes = ser::GetUserTypeProfileReport();
+    if (!userTypes.empty())
+        fprintf(stderr, "%s", userTypes.c_str());
+
+    if (!trace.empty())
+    {
+        ser::Tracer::Stop();
+        if (!ser::Tracer::Save(trace))
+        {
+            fprintf(stderr, "Failed writing %s\n", trace.c_str());
+            return 1;
+        }
+    }
+
+    if (options.output_.empty())
+        std::cout << report << std::endl;
+    else
+    {
+        std::ofstream file(options.output_);
+        file << report << std::endl;
+        if (!file)
+        {
+            fprintf(stderr, "Failed writing %s\n", options.output_.c_str());
+            return 1;
+        }
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace ser
+{
+
+namespace bench
+{
+
+/// Benchmark body. Performs one operation and returns amount of bytes it produced or consumed.
+using Function = std::function<size_t()>;
+/// Prepares input of specified size and returns benchmark body operating on it.
+using ScalingFunction = std::function<Function(size_t size)>;
+
+/// Measurements of a single benchmark.
+struct Result
+{
+    /// Name of benchmark group, for example data shape.
+    std::string group_;
+    /// Archive type.
+    std::string archive_;
+    /// Measured operation.
+    std::string operation_;
+    /// Number of measured operations.
+    size_t iterations_ = 0;
+    /// Average time of operation in nanoseconds.
+    double nsPerOp_ = 0;
+    /// Average amount of bytes produced or consumed by operation.
+    double bytesPerOp_ = 0;
+    /// Average number of memory allocations per operation.
+    double allocationsPerOp_ = 0;
+    /// Average amount of memory allocated per operation.
+    double allocatedBytesPerOp_ = 0;
+    /// Throughput in megabytes per second.
+    double mbPerSecond_ = 0;
+    /// Archive of baseline benchmark in the same group performing the same operation, if any.
+    std::string baseline_;
+    /// Ratio of operation time to operation time of baseline benchmark, 0 if there is no baseline.
+    double baselineRatio_ = 0;
+};
+
+/// Measurements of a single operation at increasing input sizes.
+struct ScalingResult
+{
+    /// Name of benchmark group, for example data shape.
+    std::string group_;
+    /// Archive type.
+    std::string archive_;
+    /// Measured operation.
+    std::string operation_;
+    /// Input sizes.
+    std::vector<size_t> sizes_;
+    /// Average time of operation in nanoseconds at each input size.
+    std::vector<double> nsPerOp_;
+    /// Fitted exponent k of time growth O(n^k).
+    double exponent_ = 0;
+    /// Fitted exponent k of time growth O(n^k * n log n). Linearithmic operations have it close to 0.
+    double excessExponent_ = 0;
+    /// True if operation does not grow faster than O(n log n).
+    bool passed_ = false;
+};
+
+/// Options of benchmark run.
+struct Options
+{
+    /// Minimal time spent measuring each benchmark, in seconds.
+    double minTime_ = 0.2;
+    /// Only benchmarks whose full name contains this string are run.
+    std::string filter_;
+    /// File to write JSON report to. Report is written to stdout if empty.
+    std::string output_;
+    /// Smallest input size of scaling checks.
+    size_t minSize_ = 1000;
+    /// Largest input size of scaling checks.
+    size_t maxSize_ = 1000000;
+    /// Largest excess exponent over O(n log n) that scaling checks tolerate.
+    double maxExcessExponent_ = 0.35;
+};
+
+/// Collection of benchmarks.
+class Suite
+{
+public:
+    /// Add a benchmark.
+    void Add(const std::string& group, const std::string& archive, const std::string& operation, Function function);
+    /// Add a benchmark and a baseline benchmark it is compared to. Result reports ratio of their times.
+    void AddComparison(const std::string& group, const std::string& operation, const std::string& archive,
+        Function function, const std::string& baselineArchive, Function baselineFunction);
+    /// Add a scaling check of an operation. Operation is measured at input sizes growing by a factor of 10.
+    void AddScaling(const std::string& group, const std::string& archive, const std::string& operation,
+        ScalingFunction function);
+    /// Run all benchmarks matching options. Progress is printed to stderr.
+    std::vector<Result> Run(const Options& options) const;
+    /// Run all scaling checks matching options. Progress is printed to stderr.
+    std::vector<ScalingResult> RunScaling(const Options& options) const;
+    /// Measure a single function.
+    static Result Measure(const std::string& group, const std::string& archive, const std::string& operation,
+        const Function& function, double minTime);
+
+private:
+    struct Benchmark
+    {
+        std::string group_;
+        std::string archive_;
+        std::string operation_;
+        Function function_;
+        std::string baseline_;
+    };
+
+    struct Scaling
+    {
+        std::string group_;
+        std::string archive_;
+        std::string operation_;
+        ScalingFunction function_;
+    };
+
+    /// Registered benchmarks.
+    std::vector<Benchmark> benchmarks_;
+    /// Registered scaling checks.
+    std::vector<Scaling> scaling_;
+};
+
+/// Returns number of allocations made by all threads so far. Both heap allocations and memory requested by archives
+/// from current memory resource during Suite::Measure() are counted.
+size_t GetAllocationCount();
+/// Returns amount of bytes allocated by all threads so far.
+size_t GetAllocatedBytes();
+
+/// Serialize results as JSON.
+std::string ToJSON(const std::vector<Result>& results);
+/// Serialize scaling results as JSON.
+std::string ToJSON(const std::vector<ScalingResult>& results);
+
+/// Register benchmarks of archive operations on representative data shapes.
+void AddShapeBenchmarks(Suite& suite);
+/// Register benchmarks comparing archives to equivalent code using rapidjson and pugixml directly.
+void AddOverheadBenchmarks(Suite& suite);
+/// Register scaling checks of archive operations whose cost depends on container size.
+void AddScalingChecks(Suite& suite);
+/// Register benchmarks comparing parallel serialization of large arrays and newline-delimited records to sequential
+/// serialization.
+void AddParallelBenchmarks(Suite& suite);
+/// Register benchmarks of saving archives through a compressing sink.
+void AddCompressionBenchmarks(Suite& suite);
+/// Register benchmarks of saving a mostly static scene with and without SerializationCache.
+void AddCachedBenchmarks(Suite& suite);
+
+}   // namespace bench
+
+}   // namespace ser
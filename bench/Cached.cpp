@@ -0,0 +1,122 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <memory>
+#include <string>
+#include <vector>
+#include "JSONArchive.h"
+#include "XMLArchive.h"
+#include "Benchmark.h"
+#include "Shapes.h"
+
+namespace ser
+{
+
+namespace bench
+{
+
+/// Object of a mostly static scene, which invalidates its cache whenever it is modified.
+struct SceneObject
+{
+    FlatObject value_;
+    SerializationCache cache_;
+};
+
+/// Scene of which a small fraction of objects changes between saves.
+struct Scene
+{
+    static const int Count = 10000;
+    /// Number of objects modified before each save.
+    static const int Changes = Count / 100;
+    std::vector<SceneObject> objects_;
+    size_t next_ = 0;
+
+    void Fill()
+    {
+        objects_.resize(Count);
+        for (auto& object : objects_)
+            object.value_.Fill();
+    }
+
+    void Modify()
+    {
+        for (int i = 0; i < Changes; i++)
+        {
+            auto& object = objects_[next_++ % objects_.size()];
+            object.value_.id_++;
+            object.cache_.Invalidate();
+        }
+    }
+
+    void Serialize(Archive* archive, bool cached)
+    {
+        auto objects = archive->Begin(archive->Begin(Archive::Map)["objects"], Archive::Array);
+        for (size_t i = 0; i < objects_.size(); i++)
+        {
+            if (cached)
+                archive->SerializeCached(objects[(int)i], objects_[i], objects_[i].cache_);
+            else
+                archive->Serialize(objects[(int)i], objects_[i]);
+        }
+    }
+};
+
+template<typename OutputArchive>
+static bool SceneObject__Serialize(OutputArchive& archive, typename OutputArchive::Iterator& it, SceneObject& value)
+{
+    auto map = archive.Begin(ArchiveIterator::ConstructR<typename OutputArchive::Iterator>(it), Archive::Map);
+    if (!map)
+        return false;
+
+    value.value_.Serialize(&archive, map);
+    return true;
+}
+
+template<typename OutputArchive>
+static void AddCachedSave(Suite& suite, const char* archive, const char* cachedArchive)
+{
+    // Both variants modify the same objects before each save, so that caches see realistic churn
+    auto scene = std::make_shared<Scene>();
+    scene->Fill();
+    auto out = std::make_shared<OutputArchive>();
+    auto save = [scene, out](bool cached) {
+        return [scene, out, cached]() {
+            scene->Modify();
+            out->Reset();
+            scene->Serialize(out.get(), cached);
+            return out->ToString().size();
+        };
+    };
+    suite.AddComparison("cached_save", "serialize", cachedArchive, save(true), archive, save(false));
+}
+
+void AddCachedBenchmarks(Suite& suite)
+{
+    SER_USER_TYPE_SERIALIZER(JSONOutputArchive, SceneObject, SceneObject__Serialize<JSONOutputArchive>);
+    SER_USER_TYPE_SERIALIZER(XMLOutputArchive, SceneObject, SceneObject__Serialize<XMLOutputArchive>);
+
+    AddCachedSave<JSONOutputArchive>(suite, "json", "json_cached");
+    AddCachedSave<XMLOutputArchive>(suite, "xml", "xml_cached");
+}
+
+}   // namespace bench
+
+}   // namespace ser
@@ -0,0 +1,87 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <memory>
+#include <string>
+#include "Compression.h"
+#include "JSONArchive.h"
+#include "XMLArchive.h"
+#include "Benchmark.h"
+#include "Shapes.h"
+
+namespace ser
+{
+
+namespace bench
+{
+
+// Array of objects saved compressed in a single pass, compared to saving it uncompressed.
+template<typename OutputArchive>
+static void AddCompressedSave(Suite& suite, const char* archive, const char* compressedArchive)
+{
+    auto out = std::make_shared<OutputArchive>();
+    if (auto values = out->Begin(Archive::Array))
+    {
+        FlatObject value;
+        value.Fill();
+        for (int i = 0; i < 10000; i++)
+        {
+            if (auto map = out->Begin(values[i], Archive::Map))
+                value.Serialize(out.get(), map);
+        }
+    }
+
+    suite.AddComparison("compressed_save", "serialize", compressedArchive, [out]() {
+        StringSink sink;
+        {
+            CompressingSink compressor(sink);
+            out->Save(compressor);
+        }
+        return sink.GetData().size();
+    }, archive, [out]() {
+        StringSink sink;
+        out->Save(sink);
+        return sink.GetData().size();
+    });
+
+    // Compressed output is decompressed before parsing
+    StringSink sink;
+    {
+        CompressingSink compressor(sink);
+        out->Save(compressor);
+    }
+    const std::string compressed = sink.GetData();
+    suite.Add("compressed_save", compressedArchive, "decompress", [compressed]() {
+        std::string result;
+        LZ4DecompressFrames(compressed.data(), compressed.size(), result);
+        return result.size();
+    });
+}
+
+void AddCompressionBenchmarks(Suite& suite)
+{
+    AddCompressedSave<JSONOutputArchive>(suite, "json", "json_lz4");
+    AddCompressedSave<XMLOutputArchive>(suite, "xml", "xml_lz4");
+}
+
+}   // namespace bench
+
+}   // namespace ser
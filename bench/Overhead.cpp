@@ -0,0 +1,249 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <memory>
+#include "pugixml/pugixml.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "JSONArchive.h"
+#include "XMLArchive.h"
+#include "Benchmark.h"
+#include "Shapes.h"
+
+namespace ser
+{
+
+namespace bench
+{
+
+// Baselines below produce and consume the same documents as archives do, but use rapidjson and pugixml directly. Ratio
+// of archive time to baseline time is the cost of going through archive abstraction.
+
+static std::string Overhead__ToString(const rapidjson::Document& document)
+{
+    rapidjson::StringBuffer buffer;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+    writer.SetIndent(' ', 4);
+    document.Accept(writer);
+    return buffer.GetString();
+}
+
+static std::string Overhead__ToString(const pugi::xml_document& document)
+{
+    struct xml_string_writer: pugi::xml_writer
+    {
+        std::string result;
+
+        void write(const void* data, size_t size) override
+        {
+            result.append(static_cast<const char*>(data), size);
+        }
+    };
+
+    xml_string_writer xml_writer{};
+    document.save(xml_writer);
+    return xml_writer.result;
+}
+
+static pugi::xml_node Overhead__AppendValue(pugi::xml_node container, const char* key)
+{
+    auto node = container.append_child("value");
+    node.append_attribute("key").set_value(key);
+    return node;
+}
+
+static pugi::xml_text Overhead__FindValue(pugi::xml_node container, const char* key)
+{
+    return container.find_child_by_attribute("value", "key", key).text();
+}
+
+// ---------------------- FlatObject ----------------------
+
+static size_t FlatObject__ToRapidJSON(const FlatObject& value)
+{
+    rapidjson::Document document;
+    auto& allocator = document.GetAllocator();
+    document.SetObject();
+    document.AddMember("id", value.id_, allocator);
+    document.AddMember("timestamp", value.timestamp_, allocator);
+    document.AddMember("flags", value.flags_, allocator);
+    document.AddMember("x", value.x_, allocator);
+    document.AddMember("y", value.y_, allocator);
+    document.AddMember("z", value.z_, allocator);
+    document.AddMember("value", value.value_, allocator);
+    document.AddMember("active", value.active_, allocator);
+    document.AddMember("name", rapidjson::StringRef(value.name_.c_str(), value.name_.size()), allocator);
+    return Overhead__ToString(document).size();
+}
+
+static size_t FlatObject__FromRapidJSON(const std::string& data)
+{
+    rapidjson::Document document;
+    document.Parse(data.c_str(), data.size());
+
+    FlatObject value;
+    value.id_ = document["id"].GetInt();
+    value.timestamp_ = document["timestamp"].GetInt64();
+    value.flags_ = document["flags"].GetUint();
+    value.x_ = document["x"].GetFloat();
+    value.y_ = document["y"].GetFloat();
+    value.z_ = document["z"].GetFloat();
+    value.value_ = document["value"].GetDouble();
+    value.active_ = document["active"].GetBool();
+    value.name_.assign(document["name"].GetString(), document["name"].GetStringLength());
+    return data.size();
+}
+
+static size_t FlatObject__ToPugiXML(const FlatObject& value)
+{
+    pugi::xml_document document;
+    auto root = document.append_child("root");
+    Overhead__AppendValue(root, "id").text().set(value.id_);
+    Overhead__AppendValue(root, "timestamp").text().set((long long)value.timestamp_);
+    Overhead__AppendValue(root, "flags").text().set(value.flags_);
+    Overhead__AppendValue(root, "x").text().set(value.x_);
+    Overhead__AppendValue(root, "y").text().set(value.y_);
+    Overhead__AppendValue(root, "z").text().set(value.z_);
+    Overhead__AppendValue(root, "value").text().set(value.value_);
+    Overhead__AppendValue(root, "active").text().set(value.active_);
+    Overhead__AppendValue(root, "name").text().set(value.name_.c_str());
+    return Overhead__ToString(document).size();
+}
+
+static size_t FlatObject__FromPugiXML(const std::string& data)
+{
+    pugi::xml_document document;
+    document.load_buffer(data.data(), data.size());
+    auto root = document.first_child();
+
+    FlatObject value;
+    value.id_ = Overhead__FindValue(root, "id").as_int();
+    value.timestamp_ = Overhead__FindValue(root, "timestamp").as_llong();
+    value.flags_ = Overhead__FindValue(root, "flags").as_uint();
+    value.x_ = Overhead__FindValue(root, "x").as_float();
+    value.y_ = Overhead__FindValue(root, "y").as_float();
+    value.z_ = Overhead__FindValue(root, "z").as_float();
+    value.value_ = Overhead__FindValue(root, "value").as_double();
+    value.active_ = Overhead__FindValue(root, "active").as_bool();
+    value.name_ = Overhead__FindValue(root, "name").get();
+    return data.size();
+}
+
+// ---------------------- NumericArray ----------------------
+
+static size_t NumericArray__ToRapidJSON(const NumericArray& value)
+{
+    rapidjson::Document document;
+    auto& allocator = document.GetAllocator();
+    document.SetArray();
+    document.Reserve((rapidjson::SizeType)value.values_.size(), allocator);
+    for (double number : value.values_)
+        document.PushBack(number, allocator);
+    return Overhead__ToString(document).size();
+}
+
+static size_t NumericArray__FromRapidJSON(const std::string& data)
+{
+    rapidjson::Document document;
+    document.Parse(data.c_str(), data.size());
+
+    NumericArray value;
+    value.values_.reserve(document.Size());
+    for (const auto& number : document.GetArray())
+        value.values_.push_back(number.GetDouble());
+    return data.size();
+}
+
+static size_t NumericArray__ToPugiXML(const NumericArray& value)
+{
+    pugi::xml_document document;
+    auto root = document.append_child("root");
+    for (double number : value.values_)
+        root.append_child("value").text().set(number);
+    return Overhead__ToString(document).size();
+}
+
+static size_t NumericArray__FromPugiXML(const std::string& data)
+{
+    pugi::xml_document document;
+    document.load_buffer(data.data(), data.size());
+
+    NumericArray value;
+    for (auto node : document.first_child().children())
+        value.values_.push_back(node.text().as_double());
+    return data.size();
+}
+
+// ---------------------- Registration ----------------------
+
+template<typename Shape, typename InputArchive, typename OutputArchive>
+static void AddOverhead(Suite& suite, const std::string& group, const char* archive, const char* baseline,
+    size_t(*save)(const Shape&), size_t(*load)(const std::string&))
+{
+    auto shape = std::make_shared<Shape>();
+    shape->Fill();
+
+    suite.AddComparison(group, "serialize", archive, [shape]() {
+        OutputArchive out;
+        shape->Serialize(&out);
+        return out.ToString().size();
+    }, baseline, [shape, save]() {
+        return save(*shape);
+    });
+
+    std::string data;
+    {
+        OutputArchive out;
+        shape->Serialize(&out);
+        data = out.ToString();
+    }
+
+    suite.AddComparison(group, "deserialize", archive, [data]() {
+        InputArchive in(data);
+        Shape copy;
+        copy.Serialize(&in);
+        return data.size();
+    }, baseline, [data, load]() {
+        return load(data);
+    });
+}
+
+template<typename Shape>
+static void AddOverhead(Suite& suite, const char* group, size_t(*toJSON)(const Shape&),
+    size_t(*fromJSON)(const std::string&), size_t(*toXML)(const Shape&), size_t(*fromXML)(const std::string&))
+{
+    std::string name = std::string("overhead_") + group;
+    AddOverhead<Shape, JSONInputArchive, JSONOutputArchive>(suite, name, "json", "rapidjson", toJSON, fromJSON);
+    AddOverhead<Shape, XMLInputArchive, XMLOutputArchive>(suite, name, "xml", "pugixml", toXML, fromXML);
+}
+
+void AddOverheadBenchmarks(Suite& suite)
+{
+    AddOverhead<FlatObject>(suite, "flat", FlatObject__ToRapidJSON, FlatObject__FromRapidJSON, FlatObject__ToPugiXML,
+        FlatObject__FromPugiXML);
+    AddOverhead<NumericArray>(suite, "numeric_array", NumericArray__ToRapidJSON, NumericArray__FromRapidJSON,
+        NumericArray__ToPugiXML, NumericArray__FromPugiXML);
+}
+
+}   // namespace bench
+
+}   // namespace ser
@@ -0,0 +1,164 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <memory>
+#include <string>
+#include <vector>
+#include "JSONArchive.h"
+#include "NDJSONArchive.h"
+#include "XMLArchive.h"
+#include "Benchmark.h"
+#include "Shapes.h"
+
+namespace ser
+{
+
+namespace bench
+{
+
+/// Large array of objects, serialized either element by element or with Archive::SerializeParallel().
+struct ObjectArray
+{
+    static const int Count = 100000;
+    std::vector<FlatObject> values_;
+
+    void Fill()
+    {
+        values_.resize(Count);
+        for (auto& value : values_)
+            value.Fill();
+    }
+
+    bool SerializeElement(Archive& archive, ArchiveIterator&& it, size_t index)
+    {
+        auto map = archive.Begin((ArchiveIterator&&)it, Archive::Map);
+        if (!map)
+            return false;
+
+        values_[index].Serialize(&archive, map);
+        return true;
+    }
+
+    void SerializeParallel(Archive* archive)
+    {
+        archive->SerializeParallel(archive->Begin(Archive::Map)["values"], values_.size(),
+            [this](Archive& archive, ArchiveIterator&& it, size_t index) {
+                return SerializeElement(archive, (ArchiveIterator&&)it, index);
+            });
+    }
+};
+
+template<typename OutputArchive>
+static void AddParallel(Suite& suite, const char* archive, const char* parallelArchive)
+{
+    auto shape = std::make_shared<ObjectArray>();
+    shape->Fill();
+
+    // Sequential variant writes the same document through a regular array iterator
+    suite.AddComparison("parallel_object_array", "serialize", parallelArchive, [shape]() {
+        OutputArchive out;
+        shape->SerializeParallel(&out);
+        return out.ToString().size();
+    }, archive, [shape]() {
+        OutputArchive out;
+        if (auto it = out.Begin(Archive::Map))
+        {
+            if (auto values = out.Begin(it["values"], Archive::Array))
+            {
+                for (size_t i = 0; i < shape->values_.size(); i++)
+                    shape->SerializeElement(out, values[(int)i], i);
+            }
+        }
+        return out.ToString().size();
+    });
+}
+
+// Records of newline-delimited JSON, formatted and parsed on a single thread and on all hardware threads.
+static void AddRecords(Suite& suite)
+{
+    auto records = std::make_shared<NDJSONOutputArchive>(nullptr);
+    if (auto it = records->Begin(Archive::Array))
+    {
+        FlatObject record;
+        record.Fill();
+        for (int i = 0; i < ObjectArray::Count; i++)
+        {
+            if (auto map = records->Begin(it[i], Archive::Map))
+                record.Serialize(records.get(), map);
+        }
+    }
+
+    auto format = [records](unsigned threads) {
+        return [records, threads]() {
+            records->SetThreads(threads);
+            return records->ToString().size();
+        };
+    };
+    suite.AddComparison("ndjson_records", "serialize", "ndjson_parallel", format(0), "ndjson", format(1));
+
+    const std::string data = records->ToString();
+    auto parse = [data](unsigned threads) {
+        return [data, threads]() {
+            NDJSONInputArchive in;
+            in.SetThreads(threads);
+            in.Load(data);
+            return data.size();
+        };
+    };
+    suite.AddComparison("ndjson_records", "deserialize", "ndjson_parallel", parse(0), "ndjson", parse(1));
+}
+
+// Single large document, parsed by splitting root array between threads and by a single sequential parse.
+static void AddLargeDocument(Suite& suite)
+{
+    auto shape = std::make_shared<ObjectArray>();
+    shape->Fill();
+
+    JSONOutputArchive out;
+    if (auto values = out.Begin(Archive::Array))
+    {
+        for (size_t i = 0; i < shape->values_.size(); i++)
+            shape->SerializeElement(out, values[(int)i], i);
+    }
+
+    const std::string data = out.ToString();
+    auto parse = [data](unsigned threads) {
+        return [data, threads]() {
+            JSONInputArchive in;
+            in.SetThreads(threads);
+            in.Load(data);
+            return data.size();
+        };
+    };
+    suite.AddComparison("large_document", "deserialize", "json_parallel", parse(0), "json", parse(1));
+}
+
+void AddParallelBenchmarks(Suite& suite)
+{
+    AddParallel<JSONOutputArchive>(suite, "json", "json_parallel");
+    AddParallel<XMLOutputArchive>(suite, "xml", "xml_parallel");
+    AddRecords(suite);
+    AddLargeDocument(suite);
+}
+
+}   // namespace bench
+
+}   // namespace ser
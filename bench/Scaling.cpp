@@ -0,0 +1,163 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <memory>
+#include <string>
+#include <vector>
+#include "JSONArchive.h"
+#include "XMLArchive.h"
+#include "Benchmark.h"
+
+namespace ser
+{
+
+namespace bench
+{
+
+// Containers below are sized at runtime. Operations on them must not grow faster than O(n log n), otherwise some
+// access path of an archive became quadratic.
+
+/// Array written and read sequentially.
+struct ScaledArray
+{
+    std::vector<int32_t> values_;
+
+    void Fill(size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+            values_.push_back((int32_t)i);
+    }
+
+    void Clear()
+    {
+        values_.clear();
+    }
+
+    void Serialize(Archive* archive)
+    {
+        if (auto it = archive->Begin(Archive::Array))
+        {
+            if (values_.empty())
+                values_.resize((size_t)it->Size());
+
+            for (size_t i = 0; i < values_.size(); i++)
+                archive->Serialize(it++, values_[i]);
+        }
+    }
+};
+
+/// Array written and read by index.
+struct ScaledIndexedArray : ScaledArray
+{
+    void Serialize(Archive* archive)
+    {
+        if (auto it = archive->Begin(Archive::Array))
+        {
+            if (values_.empty())
+                values_.resize((size_t)it->Size());
+
+            for (size_t i = 0; i < values_.size(); i++)
+                archive->Serialize(it[(int)i], values_[i]);
+        }
+    }
+};
+
+/// Map written and read by key.
+struct ScaledMap
+{
+    std::vector<std::string> keys_;
+    std::vector<int32_t> values_;
+
+    void Fill(size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            keys_.push_back("key" + std::to_string(i));
+            values_.push_back((int32_t)i);
+        }
+    }
+
+    void Clear()
+    {
+        // Keys are known to the reader
+        std::fill(values_.begin(), values_.end(), 0);
+    }
+
+    void Serialize(Archive* archive)
+    {
+        if (auto it = archive->Begin(Archive::Map))
+        {
+            for (size_t i = 0; i < keys_.size(); i++)
+                archive->Serialize(it[keys_[i]], values_[i]);
+        }
+    }
+};
+
+template<typename Shape, typename InputArchive, typename OutputArchive>
+static void AddScaling(Suite& suite, const char* group, const char* archive)
+{
+    suite.AddScaling(group, archive, "serialize", [](size_t size) -> Function {
+        auto shape = std::make_shared<Shape>();
+        shape->Fill(size);
+        return [shape]() {
+            OutputArchive out;
+            shape->Serialize(&out);
+            return out.ToString().size();
+        };
+    });
+
+    suite.AddScaling(group, archive, "deserialize", [](size_t size) -> Function {
+        auto shape = std::make_shared<Shape>();
+        shape->Fill(size);
+
+        auto data = std::make_shared<std::string>();
+        {
+            OutputArchive out;
+            shape->Serialize(&out);
+            *data = out.ToString();
+        }
+
+        return [shape, data]() {
+            shape->Clear();
+            InputArchive in(*data);
+            shape->Serialize(&in);
+            return data->size();
+        };
+    });
+}
+
+template<typename Shape>
+static void AddScaling(Suite& suite, const char* group)
+{
+    AddScaling<Shape, JSONInputArchive, JSONOutputArchive>(suite, group, "json");
+    AddScaling<Shape, XMLInputArchive, XMLOutputArchive>(suite, group, "xml");
+}
+
+void AddScalingChecks(Suite& suite)
+{
+    AddScaling<ScaledArray>(suite, "array");
+    AddScaling<ScaledIndexedArray>(suite, "indexed_array");
+    AddScaling<ScaledMap>(suite, "map");
+}
+
+}   // namespace bench
+
+}   // namespace ser
@@ -0,0 +1,133 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#include <memory>
+#include "JSONArchive.h"
+#include "XMLArchive.h"
+#include "Benchmark.h"
+#include "Shapes.h"
+
+namespace ser
+{
+
+namespace bench
+{
+
+static bool UserType__ToJSON(JSONOutputArchive& archive, JSONOutputArchive::Iterator& it, UserType& value)
+{
+    auto* target = it.Current();
+    target->SetObject();
+    target->AddMember("type", "UserType", archive.root_.GetAllocator());
+    target->AddMember("userValue", value.userValue_, archive.root_.GetAllocator());
+    return true;
+}
+
+static bool UserType__FromJSON(JSONInputArchive& /*archive*/, JSONInputArchive::Iterator& it, UserType& value)
+{
+    auto* target = it.Current();
+    if (target == nullptr || !target->IsObject())
+        return false;
+
+    auto it_value = target->FindMember("userValue");
+    if (it_value == target->MemberEnd() || !it_value->value.IsInt())
+        return false;
+
+    value.userValue_ = it_value->value.GetInt();
+    return true;
+}
+
+static bool UserType__ToXML(XMLOutputArchive& /*archive*/, XMLOutputArchive::Iterator& it, UserType& value)
+{
+    auto target = it.Current();
+    if (target.empty())
+        return false;
+
+    target.set_name("UserType");
+    target.append_child("userValue").text().set(value.userValue_);
+    return true;
+}
+
+static bool UserType__FromXML(XMLInputArchive& /*archive*/, XMLInputArchive::Iterator& it, UserType& value)
+{
+    auto target = it.Current();
+    if (target.empty())
+        return false;
+
+    auto userValue = target.child("userValue");
+    if (userValue.empty())
+        return false;
+
+    value.userValue_ = userValue.text().as_int();
+    return true;
+}
+
+template<typename Shape, typename InputArchive, typename OutputArchive>
+static void AddShape(Suite& suite, const char* group, const char* archive)
+{
+    auto shape = std::make_shared<Shape>();
+    shape->Fill();
+
+    suite.Add(group, archive, "serialize", [shape]() {
+        OutputArchive out;
+        shape->Serialize(&out);
+        return out.ToString().size();
+    });
+
+    std::string data;
+    {
+        OutputArchive out;
+        shape->Serialize(&out);
+        data = out.ToString();
+    }
+
+    suite.Add(group, archive, "deserialize", [data]() {
+        InputArchive in(data);
+        Shape copy;
+        copy.Serialize(&in);
+        return data.size();
+    });
+}
+
+template<typename Shape>
+static void AddShape(Suite& suite, const char* group)
+{
+    AddShape<Shape, JSONInputArchive, JSONOutputArchive>(suite, group, "json");
+    AddShape<Shape, XMLInputArchive, XMLOutputArchive>(suite, group, "xml");
+}
+
+void AddShapeBenchmarks(Suite& suite)
+{
+    SER_USER_TYPE_SERIALIZER(JSONOutputArchive, UserType, UserType__ToJSON);
+    SER_USER_TYPE_SERIALIZER(JSONInputArchive, UserType, UserType__FromJSON);
+    SER_USER_TYPE_SERIALIZER(XMLOutputArchive, UserType, UserType__ToXML);
+    SER_USER_TYPE_SERIALIZER(XMLInputArchive, UserType, UserType__FromXML);
+
+    AddShape<FlatObject>(suite, "flat");
+    AddShape<DeepNesting>(suite, "deep");
+    AddShape<WideMap>(suite, "wide_map");
+    AddShape<NumericArray>(suite, "numeric_array");
+    AddShape<LongStrings>(suite, "long_strings");
+    AddShape<UserTypes>(suite, "user_types");
+}
+
+}   // namespace bench
+
+}   // namespace ser
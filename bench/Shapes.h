@@ -0,0 +1,239 @@
+//
+// Copyright 2019 Rokas Kupstys
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "Archive.h"
+
+
+namespace ser
+{
+
+namespace bench
+{
+
+// Data shapes below serialize themselves with a single function for both reading and writing. Containers that are
+// empty before reading are sized from the archive.
+
+/// Typical small message with fields of all primitive types.
+struct FlatObject
+{
+    int32_t id_ = 0;
+    int64_t timestamp_ = 0;
+    uint32_t flags_ = 0;
+    float x_ = 0;
+    float y_ = 0;
+    float z_ = 0;
+    double value_ = 0;
+    bool active_ = false;
+    std::string name_;
+
+    void Fill()
+    {
+        id_ = 12345;
+        timestamp_ = 1571234567890;
+        flags_ = 0xDEADu;
+        x_ = 1.5f;
+        y_ = -2.25f;
+        z_ = 1000.125f;
+        value_ = 3.14159265358979;
+        active_ = true;
+        name_ = "flat object";
+    }
+
+    void Serialize(Archive* archive, ArchiveIterator& it)
+    {
+        archive->Serialize(it["id"], id_);
+        archive->Serialize(it["timestamp"], timestamp_);
+        archive->Serialize(it["flags"], flags_);
+        archive->Serialize(it["x"], x_);
+        archive->Serialize(it["y"], y_);
+        archive->Serialize(it["z"], z_);
+        archive->Serialize(it["value"], value_);
+        archive->Serialize(it["active"], active_);
+        archive->Serialize(it["name"], name_);
+    }
+
+    void Serialize(Archive* archive)
+    {
+        if (auto it = archive->Begin(Archive::Map))
+            Serialize(archive, it);
+    }
+};
+
+/// Chain of nested maps.
+struct DeepNesting
+{
+    static const int Depth = 256;
+    std::vector<int32_t> values_;
+
+    void Fill()
+    {
+        for (int i = 0; i < Depth; i++)
+            values_.push_back(i);
+    }
+
+    void Serialize(Archive* archive, ArchiveIterator&& it, size_t level)
+    {
+        if (level >= values_.size())
+            return;
+
+        archive->Serialize(it["value"], values_[level]);
+        if (auto child = archive->Begin(it["child"], Archive::Map))
+            Serialize(archive, std::move(child), level + 1);
+    }
+
+    void Serialize(Archive* archive)
+    {
+        if (values_.empty())
+            values_.resize(Depth);
+
+        if (auto it = archive->Begin(Archive::Map))
+            Serialize(archive, std::move(it), 0);
+    }
+};
+
+/// Map with many keys.
+struct WideMap
+{
+    static const int Keys = 100000;
+    std::vector<std::string> keys_;
+    std::vector<int32_t> values_;
+
+    void Fill()
+    {
+        for (int i = 0; i < Keys; i++)
+        {
+            keys_.push_back("key" + std::to_string(i));
+            values_.push_back(i);
+        }
+    }
+
+    void Serialize(Archive* archive)
+    {
+        if (keys_.empty())
+        {
+            Fill();
+            std::fill(values_.begin(), values_.end(), 0);
+        }
+
+        if (auto it = archive->Begin(Archive::Map))
+        {
+            for (size_t i = 0; i < keys_.size(); i++)
+                archive->Serialize(it[keys_[i]], values_[i]);
+        }
+    }
+};
+
+/// Large array of numbers.
+struct NumericArray
+{
+    static const int Count = 100000;
+    std::vector<double> values_;
+
+    void Fill()
+    {
+        for (int i = 0; i < Count; i++)
+            values_.push_back(i * 0.731 - 1000.0);
+    }
+
+    void Serialize(Archive* archive)
+    {
+        if (auto it = archive->Begin(Archive::Array))
+        {
+            if (values_.empty())
+                values_.resize((size_t)it->Size());
+
+            for (size_t i = 0; i < values_.size(); i++)
+                archive->Serialize(it++, values_[i]);
+        }
+    }
+};
+
+/// Few long strings.
+struct LongStrings
+{
+    static const int Count = 64;
+    static const int Length = 16 * 1024;
+    std::vector<std::string> values_;
+
+    void Fill()
+    {
+        for (int i = 0; i < Count; i++)
+        {
+            std::string value(Length, ' ');
+            for (int j = 0; j < Length; j++)
+                value[j] = (char)('a' + (i + j) % 26);
+            values_.push_back(std::move(value));
+        }
+    }
+
+    void Serialize(Archive* archive)
+    {
+        if (auto it = archive->Begin(Archive::Array))
+        {
+            if (values_.empty())
+                values_.resize((size_t)it->Size());
+
+            for (size_t i = 0; i < values_.size(); i++)
+                archive->Serialize(it++, values_[i]);
+        }
+    }
+};
+
+/// Type with custom per-format serialization.
+struct UserType
+{
+    int32_t userValue_ = 0;
+};
+
+/// Array of user types.
+struct UserTypes
+{
+    static const int Count = 10000;
+    std::vector<UserType> values_;
+
+    void Fill()
+    {
+        for (int i = 0; i < Count; i++)
+            values_.push_back(UserType{i});
+    }
+
+    void Serialize(Archive* archive)
+    {
+        if (auto it = archive->Begin(Archive::Array))
+        {
+            if (values_.empty())
+                values_.resize((size_t)it->Size());
+
+            for (size_t i = 0; i < values_.size(); i++)
+                archive->Serialize(it++, values_[i]);
+        }
+    }
+};
+
+}   // namespace bench
+
+}   // namespace ser
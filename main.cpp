@@ -19,9 +19,14 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 // DEALINGS IN THE SOFTWARE.
 //
+#include <algorithm>
 #include <typeindex>
 #include <iostream>
+#include "ArchivePool.h"
+#include "Compression.h"
 #include "JSONArchive.h"
+#include "NDJSONArchive.h"
+#include "RecordStream.h"
 #include "XMLArchive.h"
 
 
@@ -50,7 +55,7 @@ bool SerializeToJSON(JSONOutputArchive& archive, JSONOutputArchive::Iterator& it
     return true;
 }
 
-bool SerializeFromJSON(JSONInputArchive& archive, JSONInputArchive::Iterator& it, UserType& value)
+bool SerializeFromJSON(JSONInputArchive& /*archive*/, JSONInputArchive::Iterator& it, UserType& value)
 {
     auto* target = it.Current();
     if (target == nullptr)
@@ -76,7 +81,7 @@ bool SerializeFromJSON(JSONInputArchive& archive, JSONInputArchive::Iterator& it
     return true;
 }
 
-bool SerializeToXML(XMLOutputArchive& archive, XMLOutputArchive::Iterator& it, UserType& value)
+bool SerializeToXML(XMLOutputArchive& /*archive*/, XMLOutputArchive::Iterator& it, UserType& value)
 {
     auto target = it.Current();
     if (target.empty())
@@ -88,7 +93,7 @@ bool SerializeToXML(XMLOutputArchive& archive, XMLOutputArchive::Iterator& it, U
     return true;
 }
 
-bool SerializeFromXML(XMLInputArchive& archive, XMLInputArchive::Iterator& it, UserType& value)
+bool SerializeFromXML(XMLInputArchive& /*archive*/, XMLInputArchive::Iterator& it, UserType& value)
 {
     auto target = it.Current();
     if (target.empty())
@@ -172,6 +177,385 @@ void test()
     assert(obj_out.user.userValue == obj_in.user.userValue);
 }
 
+template<typename OutputArchive>
+void test_pool()
+{
+    // Archive is reset when handle goes out of scope, second document reuses memory of the first one
+    std::string first;
+    for (int i = 0; i < 2; i++)
+    {
+        auto out = ArchivePool<OutputArchive>::Acquire();
+        SerializableObject obj_out;
+        obj_out.value1 = 1;
+        obj_out.user.userValue = 4;
+        obj_out.Serialize(out.Get());
+
+        if (i == 0)
+            first = out->ToString();
+        else
+            assert(first == out->ToString());
+    }
+}
+
+// Heap resource which counts its allocations.
+class CountingResource : public MemoryResource
+{
+public:
+    void* Allocate(size_t size) override
+    {
+        allocations_++;
+        return malloc(size);
+    }
+    void Deallocate(void* ptr, size_t /*size*/) override { free(ptr); }
+
+    size_t allocations_ = 0;
+};
+
+void test_user_type_memory()
+{
+    // User types allocate from resource of archive, not from request arena current at the time. Arena is destroyed
+    // before output is formatted.
+    auto out = ArchivePool<XMLOutputArchive>::Acquire();
+    CountingResource upstream;
+    {
+        MonotonicBufferResource arena(64 * 1024, &upstream);
+        MemoryResourceScope scope(&arena);
+        Archive* archive = out.Get();
+        UserType user;
+        user.userValue = 4;
+        if (auto it = archive->Begin(Archive::Array))
+        {
+            for (int i = 0; i < 2000; i++)
+                archive->Serialize(it++, user);
+        }
+    }
+    assert(upstream.allocations_ == 0);
+    assert(out->ToString().find("<userValue>4</userValue>") != std::string::npos);
+}
+
+void test_index_memory()
+{
+    // Key index of a large object belongs to archive, it is not allocated from request arena current at the time
+    auto out = ArchivePool<JSONOutputArchive>::Acquire();
+    CountingResource upstream;
+    {
+        MonotonicBufferResource arena(64 * 1024, &upstream);
+        MemoryResourceScope scope(&arena);
+        Archive* archive = out.Get();
+        if (auto map = archive->Begin(Archive::Map))
+        {
+            for (int i = 0; i < 40; i++)
+                archive->Serialize(map["key" + std::to_string(i)], i);
+        }
+    }
+    assert(upstream.allocations_ == 0);
+}
+
+void test_xml_numbers()
+{
+    // Numbers are read as std::stoll() and std::stod() read them, except that trailing text and overflow are errors
+    XMLInputArchive in("<root><value>+5</value><value>007</value><value>1.</value><value>1e39</value>"
+        "<value>5x</value><value>1.5</value></root>");
+    auto it = in.Begin(Archive::Array);
+    int plus = 0, zeros = 0, trailing = 0, fraction = 0;
+    double point = 0;
+    float overflow = 0;
+    assert(in.Serialize(it[0], plus) && plus == 5);
+    assert(in.Serialize(it[1], zeros) && zeros == 7);
+    assert(in.Serialize(it[2], point) && point == 1.0);
+    assert(!in.Serialize(it[3], overflow));
+    assert(!in.Serialize(it[4], trailing));
+    assert(!in.Serialize(it[5], fraction));
+}
+
+void test_cache_patch()
+{
+    // Second and third documents splice cached value, patching a document must not modify the cache
+    UserType user;
+    user.userValue = 4;
+    SerializationCache cache;
+    JSONInputArchive patch("{\"user\":{\"userValue\":99}}");
+    std::string first;
+    for (int i = 0; i < 3; i++)
+    {
+        JSONOutputArchive out;
+        if (auto map = out.Begin(Archive::Map))
+            out.SerializeCached(map["user"], user, cache);
+
+        if (i == 0)
+            first = out.ToString();
+        else
+            assert(first == out.ToString());
+        out.ApplyMergePatch(patch);
+    }
+}
+
+void test_parse_parallel()
+{
+    // Document is large enough to be split between threads. Strings contain brackets, commas and escaped quotes, which
+    // chunk boundaries may fall into.
+    JSONOutputArchive out;
+    if (auto map = out.Begin(Archive::Map))
+    {
+        for (int i = 0; i < 20000; i++)
+        {
+            std::string value = "[{\\\",}] " + std::to_string(i);
+            out.Serialize(map["key" + std::to_string(i)], value);
+        }
+        if (auto array = out.Begin(map["array"], Archive::Array))
+        {
+            for (int i = 0; i < 20000; i++)
+                out.Serialize(array++, i);
+        }
+    }
+    const std::string json = out.ToString();
+    assert(json.size() > 512 * 1024);
+
+    JSONInputArchive in;
+    in.SetThreads(4);
+    assert(in.Load(json));
+    auto map = in.Begin(Archive::Map);
+    for (int i = 0; i < 20000; i += 997)
+    {
+        std::string value;
+        assert(in.Serialize(map["key" + std::to_string(i)], value) && value == "[{\\\",}] " + std::to_string(i));
+    }
+    auto array = in.Begin(map["array"], Archive::Array);
+    int last = 0;
+    assert(in.Serialize(array[19999], last) && last == 19999);
+
+    // Malformed document is rejected the same way it is rejected by a single thread
+    assert(!in.Load(json.substr(0, json.size() - 2)));
+}
+
+void test_record_stream()
+{
+    // Stream is flushed in pieces, index still counts offsets from the beginning of stream
+    RecordWriter writer;
+    std::string stream;
+    for (int i = 0; i < 100; i++)
+    {
+        JSONOutputArchive out;
+        if (auto map = out.Begin(Archive::Map))
+            out.Serialize(map["record"], i);
+        assert(writer.Write(out.ToString()) == (size_t)i);
+        if (i % 10 == 0)
+            stream += writer.Flush();
+    }
+    writer.Finish();
+    stream += writer.Flush();
+
+    RecordReader reader(stream.data(), stream.size());
+    assert(reader.IsValid() && reader.IsIndexed() && reader.GetCount() == 100);
+    for (int i : {57, 0, 99, 13})
+    {
+        JSONInputArchive in(reader[i].ToString());
+        int record = -1;
+        assert(in.Serialize(in.Begin(Archive::Map)["record"], record) && record == i);
+    }
+    assert(!reader[100]);
+
+    // Stream without index is read by scanning, truncated last record is dropped
+    RecordWriter plain;
+    plain.Write("first");
+    plain.Write("second");
+    const std::string truncated = plain.GetData().substr(0, plain.GetData().size() - 1);
+    RecordReader scanned(truncated.data(), truncated.size());
+    assert(!scanned.IsValid() && !scanned.IsIndexed() && scanned.GetCount() == 1);
+    assert(scanned[0].ToString() == "first");
+}
+
+void test_feed()
+{
+    // Document arrives in pieces that split tokens, strings and escapes
+    JSONOutputArchive out;
+    SerializableObject obj_out;
+    obj_out.value11 = 11;
+    obj_out.value2 = 2;
+    obj_out.user.userValue = 4;
+    obj_out.Serialize(&out);
+    if (auto map = out.Begin(out.Begin(Archive::Array)[5], Archive::Map))
+    {
+        std::string text = "a \"quoted\" ,] text";
+        out.Serialize(map["text"], text);
+    }
+    const std::string json = out.ToString();
+
+    JSONInputArchive in;
+    for (size_t i = 0; i < json.size(); i += 3)
+        assert(in.Feed(json.data() + i, std::min<size_t>(3, json.size() - i)));
+    assert(in.IsFeedComplete() && in.EndFeed());
+    SerializableObject obj_in;
+    obj_in.Serialize(&in);
+    assert(obj_in.value11 == 11 && obj_in.value2 == 2 && obj_in.user.userValue == 4);
+    std::string text;
+    auto map = in.Begin(in.Begin(Archive::Array)[5], Archive::Map);
+    assert(in.Serialize(map["text"], text) && text == "a \"quoted\" ,] text");
+
+    // Scalar root is parsed once input ends, incomplete document keeps elements received so far
+    assert(in.Feed("4", 1) && in.Feed("2", 1) && !in.IsFeedComplete() && in.EndFeed());
+    assert(in.Feed("[1, 2, [3", 9) && !in.EndFeed());
+    int second = 0;
+    assert(in.Serialize(in.Begin(Archive::Array)[1], second) && second == 2);
+}
+
+void test_compression()
+{
+    // Output spans several blocks, second frame is appended after the first one is finished
+    JSONOutputArchive out;
+    if (auto map = out.Begin(Archive::Map))
+    {
+        for (int i = 0; i < 20000; i++)
+            out.Serialize(map["key" + std::to_string(i)], i);
+    }
+    const std::string json = out.ToString();
+    StringSink compressed;
+    {
+        CompressingSink sink(compressed);
+        assert(out.Save(sink) && sink.Finish());
+        assert(sink.Write("tail", 4));
+    }
+    assert(compressed.GetData().size() < json.size() / 2);
+
+    std::string result;
+    assert(LZ4DecompressFrames(compressed.GetData().data(), compressed.GetData().size(), result));
+    assert(result == json + "tail");
+
+    // Input arrives in pieces that split headers and blocks
+    StringSink decompressed;
+    DecompressingSink sink(decompressed);
+    const std::string& input = compressed.GetData();
+    for (size_t i = 0; i < input.size(); i += 1000)
+        assert(sink.Write(input.data() + i, std::min<size_t>(1000, input.size() - i)));
+    assert(sink.IsComplete() && decompressed.GetData() == json + "tail");
+    assert(!LZ4DecompressFrames(input.data(), input.size() - 1, result));
+}
+
+// Writes baseline (version 0) or current (version 1) document of delta and patch tests.
+void write_versioned(Archive* archive, int version)
+{
+    if (auto map = archive->Begin(Archive::Map))
+    {
+        int changed = version ? 10 : 1, removed = 2, kept = 3, added = 5;
+        archive->Serialize(map["changed"], changed);
+        if (version == 0)
+            archive->Serialize(map["removed"], removed);
+        archive->Serialize(map["kept"], kept);
+
+        // Element of user type is renamed, it is found by its key
+        UserType user;
+        user.userValue = version ? 40 : 4;
+        archive->Serialize(map["user"], user);
+
+        if (auto array = archive->Begin(map["shrinks"], Archive::Array))
+        {
+            for (int i = 1; i <= 3 - version; i++)
+            {
+                int item = i == 2 ? i * (1 + version * 9) : i;
+                archive->Serialize(array++, item);
+            }
+        }
+        if (auto array = archive->Begin(map["grows"], Archive::Array))
+        {
+            for (int i = 1; i <= 1 + version * 2; i++)
+                archive->Serialize(array++, i);
+        }
+
+        // Large enough to be indexed
+        if (auto many = archive->Begin(map["many"], Archive::Map))
+        {
+            for (int i = 0; i < 20; i++)
+            {
+                int value = version && i == 7 ? -i : i;
+                if (!version || i != 5)
+                    archive->Serialize(many["key" + std::to_string(i)], value);
+            }
+        }
+        if (version)
+            archive->Serialize(map["added"], added);
+    }
+}
+
+template<typename InputArchive, typename OutputArchive>
+void test_delta()
+{
+    OutputArchive baseline, current, delta, target;
+    write_versioned(&baseline, 0);
+    write_versioned(&current, 1);
+    write_versioned(&target, 0);
+    current.MakeDelta(baseline, delta);
+    const std::string text = delta.ToString();
+    assert(text.find("kept") == std::string::npos && text.find("key8") == std::string::npos);
+
+    // Delta is sent as text and turns baseline into current document
+    InputArchive received(text);
+    assert(target.ApplyDelta(received));
+    assert(target.ToString() == current.ToString());
+
+    // Equal documents make a delta that changes nothing
+    current.MakeDelta(current, delta);
+    assert(target.ApplyDelta(delta));
+    assert(target.ToString() == current.ToString());
+}
+
+void test_patch()
+{
+    // JSON patch and merge patch are sent as text and turn source into current document
+    JSONOutputArchive source, current, patch, target, merged;
+    write_versioned(&source, 0);
+    write_versioned(&current, 1);
+    write_versioned(&target, 0);
+    write_versioned(&merged, 0);
+
+    current.MakePatch(source, patch);
+    JSONInputArchive received(patch.ToString());
+    assert(target.ApplyPatch(received));
+    assert(target.ToString() == current.ToString());
+
+    current.MakeMergePatch(source, patch);
+    JSONInputArchive receivedMerge(patch.ToString());
+    merged.ApplyMergePatch(receivedMerge);
+    assert(merged.ToString() == current.ToString());
+
+    // Patches of equal documents keep object, array and scalar roots as they are
+    for (const char* json : {"{\"a\":[1]}", "[1,{\"a\":2}]", "3"})
+    {
+        JSONInputArchive document(json), expected(json), equal;
+        document.MakePatch(expected, equal);
+        assert(equal.root_.IsArray() && equal.root_.Empty());
+        assert(document.ApplyPatch(equal) && document.root_ == expected.root_);
+        document.MakeMergePatch(expected, equal);
+        document.ApplyMergePatch(equal);
+        assert(document.root_ == expected.root_);
+    }
+}
+
+void test_ndjson()
+{
+    // Records are written and read as NDJSON through references to base archives as well
+    NDJSONOutputArchive records;
+    JSONOutputArchive& out = records;
+    if (auto array = out.Begin(Archive::Array))
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (auto map = out.Begin(array++, Archive::Map))
+                out.Serialize(map["record"], i);
+        }
+    }
+    const std::string text = out.ToString();
+    assert(text == "{\"record\":0}\n{\"record\":1}\n{\"record\":2}\n");
+    assert(out.ToString(text.size()) == text);
+    StringSink sink;
+    assert(out.Save(sink) && sink.GetData() == text);
+
+    NDJSONInputArchive parsed;
+    JSONInputArchive& in = parsed;
+    assert(in.Load(text));
+    int record = 0;
+    assert(in.Serialize(in.Begin(in.Begin(Archive::Array)[2], Archive::Map)["record"], record) && record == 2);
+}
+
 int main()
 {
     SER_USER_TYPE_SERIALIZER(JSONOutputArchive, UserType, SerializeToJSON);
@@ -181,5 +565,19 @@ int main()
 
     test<JSONInputArchive, JSONOutputArchive>();
     test<XMLInputArchive, XMLOutputArchive>();
+    test_pool<JSONOutputArchive>();
+    test_pool<XMLOutputArchive>();
+    test_user_type_memory();
+    test_index_memory();
+    test_xml_numbers();
+    test_cache_patch();
+    test_parse_parallel();
+    test_record_stream();
+    test_feed();
+    test_compression();
+    test_delta<JSONInputArchive, JSONOutputArchive>();
+    test_delta<XMLInputArchive, XMLOutputArchive>();
+    test_patch();
+    test_ndjson();
     return 0;
 }